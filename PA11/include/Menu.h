@@ -52,6 +52,25 @@ class Menu {
 			bool rotateBack = false;
 			
 			glm::vec3 ambientColor = glm::vec3(0.05, 0.05, 0.05);
+			
+			bool glPicking = false; //Debug: pick by rendering object ids and reading them back, instead of ray casting
+		};
+		
+		//What the renderer did last frame, filled in by Graphics
+		struct Stats {
+			unsigned drawn = 0;        //Objects drawn to the screen
+			unsigned culled = 0;       //Objects skipped for being outside the camera's view
+			unsigned shadowDrawn = 0;  //Objects drawn into shadow maps, added up over every light
+			unsigned shadowCulled = 0; //Objects skipped for being outside a light's view
+			
+			unsigned drawCalls = 0;       //From GLState's counters
+			unsigned stateChanges = 0;
+			unsigned redundantStates = 0; //Binds and enables GLState skipped
+			unsigned uniformUploads = 0;
+			
+			unsigned long heapAllocations = 0; //Calls to operator new on the render thread during Graphics::Render(), if counted
+			size_t arenaUsed = 0;              //Bytes of Graphics' frame arena used
+			size_t arenaCapacity = 0;
 		};
 		
 		Menu(Window& window);
@@ -76,6 +95,7 @@ class Menu {
 		bool isNewGame = false;
 		//Read-only menu options
 		const Options& options;
+		Stats stats;
 	private:
 		//Keep track of where we're rendering and the sun
 		Window& window;
@@ -0,0 +1,34 @@
+#ifndef ASSET_LOADER_H
+#define ASSET_LOADER_H
+
+#include <string>
+#include <unordered_map>
+#include <future>
+
+#include "job_pool.h"
+#include "model.h"
+
+//Loads models and textures on a JobPool, so files are imported and decoded in parallel
+//Request everything first, then get() each asset as it's needed
+//Only the loading runs on the workers - OpenGL still has to be initialised on the main thread
+class AssetLoader {
+	public:
+		AssetLoader(JobPool& pool);
+		
+		//Start loading a file, if it isn't already
+		void requestModel(const std::string& filename);
+		void requestTexture(const std::string& filename, bool normalMap = false);
+		
+		//Wait for a file to finish loading, requesting it first if needed
+		//nullptr if it couldn't be loaded, same as Model::load() and Texture::load()
+		Model* getModel(const std::string& filename);
+		Texture* getTexture(const std::string& filename, bool normalMap = false);
+		
+	private:
+		JobPool& m_pool;
+		
+		std::unordered_map<std::string, std::shared_future<Model*>> m_models;
+		std::unordered_map<std::string, std::shared_future<Texture*>> m_textures;
+};
+
+#endif /* ASSET_LOADER_H */
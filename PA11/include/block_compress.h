@@ -0,0 +1,59 @@
+#ifndef BLOCK_COMPRESS_H
+#define BLOCK_COMPRESS_H
+
+#include <vector>
+#include <cstdint>
+
+#include "texture_cache.h"
+
+//Compressed formats, in case the OpenGL headers don't have them
+#define BLOCK_FORMAT_BC1 0x83F0 //GL_COMPRESSED_RGB_S3TC_DXT1_EXT - colour maps
+#define BLOCK_FORMAT_BC3 0x83F3 //GL_COMPRESSED_RGBA_S3TC_DXT5_EXT - anything with alpha
+#define BLOCK_FORMAT_BC5 0x8DBD //GL_COMPRESSED_RG_RGTC2 - normal maps, X and Y only
+
+//Encodes RGBA8 mip chains into BC1/BC3/BC5 blocks when texture caches are built,
+//and decodes them again for drivers that can't sample them
+class BlockCompress {
+	public:
+		//Pick a format for some RGBA8 pixels
+		//Normal maps get BC5, anything that isn't fully opaque gets BC3, and the rest get BC1
+		static uint32_t chooseFormat(const unsigned char* rgba, unsigned width, unsigned height, bool normalMap);
+		
+		//Whether a format is one of the block formats above
+		static bool isCompressed(uint32_t format);
+		//Whether the current OpenGL context can sample a format directly
+		//Call after starting OpenGL
+		static bool isSupported(uint32_t format);
+		
+		//Compress an RGBA8 mip chain into format, replacing image and pixels
+		static void compress(uint32_t format, TextureCache::Image& image, std::vector<unsigned char>& pixels);
+		//Decompress a block compressed mip chain back into RGBA8, replacing image and pixels
+		//image.data may point into some other buffer, such as a cache mapping
+		static void decompress(TextureCache::Image& image, std::vector<unsigned char>& pixels);
+		
+		//Bytes needed to store one level of a format
+		static uint64_t levelSize(uint32_t format, unsigned width, unsigned height);
+		//Compress or decompress a single level
+		static void compressLevel(uint32_t format, const unsigned char* rgba, unsigned width, unsigned height, unsigned char* blocks);
+		static void decompressLevel(uint32_t format, const unsigned char* blocks, unsigned width, unsigned height, unsigned char* rgba);
+		
+	private:
+		static unsigned blockSize(uint32_t format);
+		
+		//Copy a 4x4 block of pixels out of a level, repeating the last row and column past the edges
+		static void fetchBlock(const unsigned char* rgba, unsigned width, unsigned height, unsigned x, unsigned y, unsigned char* block);
+		//Smallest and largest value of each channel in a block
+		static void boundingBox(const unsigned char* block, unsigned char* minColor, unsigned char* maxColor);
+		
+		//8 bytes of 565 endpoints and 2-bit indices
+		static void encodeColorBlock(const unsigned char* block, unsigned char* out);
+		static void decodeColorBlock(const unsigned char* in, bool fourColor, unsigned char* block);
+		//8 bytes of 8-bit endpoints and 3-bit indices, for one channel of a block
+		static void encodeAlphaBlock(const unsigned char* block, unsigned channel, unsigned char* out);
+		static void decodeAlphaBlock(const unsigned char* in, unsigned channel, unsigned char* block);
+		
+		static uint16_t packColor(const unsigned char* color);
+		static void unpackColor(uint16_t packed, unsigned char* color);
+};
+
+#endif /* BLOCK_COMPRESS_H */
@@ -0,0 +1,44 @@
+#ifndef BVH_CACHE_H
+#define BVH_CACHE_H
+
+#include <string>
+#include <cstdint>
+#include <btBulletDynamicsCommon.h>
+
+#include "mapped_file.h"
+
+//Cache files sit next to the collision model, with this added to the name
+#define BVH_CACHE_EXTENSION ".bvhcache"
+#define BVH_CACHE_MAGIC     0x48564242 //"BBVH"
+//Bump this whenever the file layout or how collision triangles are made changes
+#define BVH_CACHE_VERSION   1
+//Bullet needs serialised BVHs this aligned
+#define BVH_CACHE_ALIGNMENT 16
+
+//Bullet's quantised BVH for a static triangle mesh, saved so later runs don't have to build it again
+//Layout: BvhCache::Header, then the btOptimizedBvh as serialised by Bullet
+class BvhCache {
+	public:
+		//Load the cached BVH of triangles, which were made from modelFile at scale
+		//The BVH lives in buffer, which must be freed with btAlignedFree once nothing uses it
+		//Returns nullptr if there's no cache, or it's for other triangles - the BVH should be built normally then
+		static btOptimizedBvh* read(const std::string& modelFile, const btVector3& scale, btStridingMeshInterface* triangles, void*& buffer);
+		//Save a built BVH for next time. Failing to write isn't an error - the cache is just skipped
+		static bool write(const std::string& modelFile, const btVector3& scale, btStridingMeshInterface* triangles, btOptimizedBvh* bvh);
+		
+	private:
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t scalarSize;    //sizeof(btScalar) when written, as Bullet may be built with doubles
+			uint32_t triangleCount;
+			uint64_t triangleHash;  //Of every vertex and index, which already have the scale applied
+			float scale[3];
+			uint32_t bvhSize;
+		};
+		
+		//Get the details of some triangles to compare against a cache
+		static void describeTriangles(const btVector3& scale, btStridingMeshInterface* triangles, Header& header);
+};
+
+#endif /* BVH_CACHE_H */
@@ -0,0 +1,42 @@
+#ifndef CONVEX_DECOMPOSITION_H
+#define CONVEX_DECOMPOSITION_H
+
+#include <vector>
+#include <btBulletDynamicsCommon.h>
+
+//Most vertices kept in each convex hull - Bullet checks every one when finding contacts
+#define CONVEX_DECOMPOSITION_MAX_HULL_VERTICES 48
+//Most times a mesh is halved, so it's split into at most 2^this parts
+#define CONVEX_DECOMPOSITION_MAX_DEPTH 4
+//Only split a part if its halves' hulls are at least this much smaller than its own, as a fraction of it
+#define CONVEX_DECOMPOSITION_MIN_GAIN 0.1f
+
+//Builds cheap collision shapes for moving meshes, in place of checking every triangle
+//Convex meshes become one hull with its vertices capped, and concave ones are approximated by several
+//Parts are found by halving the mesh across its longest side for as long as that cuts away a good amount of empty space
+class ConvexDecomposition {
+	public:
+		//A btConvexHullShape if the mesh is close enough to convex, or a btCompoundShape of them if not
+		//A compound's children are owned by whoever deletes it
+		static btCollisionShape* createShape(btStridingMeshInterface* triangles);
+		
+	private:
+		//Gathers every triangle of a mesh, with its scaling applied
+		class TriangleCollector : public btInternalTriangleIndexCallback {
+			public:
+				TriangleCollector(std::vector<btVector3>& corners);
+				void internalProcessTriangleIndex(btVector3* triangle, int partId, int triangleIndex) override;
+			
+			private:
+				std::vector<btVector3>& m_corners;
+		};
+		
+		//Split triangles (3 corners each) into parts which are each roughly convex
+		static void decompose(const std::vector<btVector3>& corners, unsigned depth, std::vector<std::vector<btVector3>>& parts);
+		//Volume of the convex hull around points - 0 if they're flat
+		static btScalar hullVolume(const std::vector<btVector3>& points);
+		//A convex hull around points, with at most CONVEX_DECOMPOSITION_MAX_HULL_VERTICES vertices
+		static btConvexHullShape* createHull(const std::vector<btVector3>& points);
+};
+
+#endif /* CONVEX_DECOMPOSITION_H */
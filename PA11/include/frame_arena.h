@@ -0,0 +1,49 @@
+#ifndef FRAME_ARENA_H
+#define FRAME_ARENA_H
+
+#include <vector>
+#include <cstddef>
+#include <cstdlib>
+
+//Starting size of Graphics' arena - it grows on its own if a frame needs more
+#define FRAME_ARENA_DEFAULT_SIZE (64 * 1024)
+
+//Bump allocator for arrays which only live until the end of a frame
+//Allocating is just moving an offset along one block, and everything is freed at once by reset()
+//Nothing is constructed or destroyed, so only use it for plain data
+class FrameArena {
+	public:
+		FrameArena(size_t capacity = FRAME_ARENA_DEFAULT_SIZE);
+		~FrameArena();
+		
+		//Free everything allocated since the last reset
+		//If the last frame ran out of room, the block is made big enough for it here
+		void reset();
+		
+		//Get size bytes, aligned to alignment, which stay valid until the next reset()
+		void* allocate(size_t size, size_t alignment = alignof(std::max_align_t));
+		//Get room for count Ts
+		template<typename T>
+		T* allocate(size_t count) {
+			return static_cast<T*>(allocate(sizeof(T) * count, alignof(T)));
+		}
+		
+		//Bytes handed out since the last reset
+		size_t used() const;
+		size_t capacity() const;
+		
+		//How many times operator new has been called by the calling thread
+		//Only counted when built with COUNT_ALLOCATIONS - otherwise always 0
+		static unsigned long heapAllocations();
+		
+	private:
+		unsigned char* m_block;
+		size_t m_capacity;
+		size_t m_used;
+		
+		//Blocks from malloc for allocations which didn't fit this frame, freed on reset()
+		std::vector<void*> m_overflow;
+		size_t m_overflowSize;
+};
+
+#endif /* FRAME_ARENA_H */
@@ -0,0 +1,21 @@
+#ifndef FRUSTUM_H
+#define FRUSTUM_H
+
+#include "graphics_headers.h"
+
+//The six planes of a view volume, for skipping objects that can't be seen
+class Frustum {
+	public:
+		Frustum();
+		//Planes of the volume a View-Projection matrix draws
+		Frustum(const glm::mat4& viewProjection);
+		
+		//Whether any part of a sphere could be inside the volume
+		bool intersectsSphere(const glm::vec3& center, float radius) const;
+		
+	private:
+		//xyz is the normal, pointing inwards, and w the distance, so inside points have dot(plane, point) >= 0
+		glm::vec4 planes[6];
+};
+
+#endif /* FRUSTUM_H */
@@ -0,0 +1,100 @@
+#ifndef GL_STATE_H
+#define GL_STATE_H
+
+#include "graphics_headers.h"
+
+//Texture units whose bindings are remembered - units past this are always bound
+#define GL_STATE_TEXTURE_UNITS 16
+//Uniform buffer binding points whose ranges are remembered
+#define GL_STATE_UNIFORM_BINDINGS 8
+
+//Remembers the OpenGL state the engine last set, so setting it to the same thing again costs nothing
+//All of the engine's binds and enables go through here - anything else touching OpenGL (like ImGui) must call invalidate() afterwards
+//Buffers and programs have to be deleted through here too, so a new object given the same name isn't mistaken for the old one
+class GLState {
+	public:
+		//What went to OpenGL since the last resetCounters()
+		struct Counters {
+			unsigned drawCalls = 0;
+			unsigned stateChanges = 0;   //Binds and enables which actually changed something
+			unsigned redundant = 0;      //Binds and enables skipped for already being set
+			unsigned uniformUploads = 0; //glUniform*() calls and uniform buffer writes
+		};
+		
+		static void useProgram(GLuint program);
+		static void bindVertexArray(GLuint vao);
+		//GL_ELEMENT_ARRAY_BUFFER belongs to the bound VAO, so it's forgotten whenever the VAO changes
+		static void bindBuffer(GLenum target, GLuint buffer);
+		static void bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+		//Bind a texture to a unit (GL_TEXTURE0 + i), making it the active unit
+		static void bindTexture(GLenum unit, GLenum target, GLuint texture);
+		//Bind a texture to whichever unit is active, for creating and uploading it
+		static void bindTexture(GLenum target, GLuint texture);
+		static void bindFramebuffer(GLenum target, GLuint framebuffer);
+		static void viewport(GLint x, GLint y, GLsizei width, GLsizei height);
+		
+		//Only GL_DEPTH_TEST, GL_CULL_FACE and GL_BLEND are remembered
+		static void enable(GLenum capability);
+		static void disable(GLenum capability);
+		static void depthFunc(GLenum func);
+		static void cullFace(GLenum mode);
+		static void blendFunc(GLenum source, GLenum destination);
+		
+		static void deleteBuffer(GLuint buffer);
+		static void deleteProgram(GLuint program);
+		
+		static void drawElements(GLenum mode, GLsizei count, GLenum type, const void* offset);
+		static void drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* offset, GLsizei instances);
+		static void drawArrays(GLenum mode, GLint first, GLsizei count);
+		//Uniforms are set by Shader and UniformBuffer directly, which just report it here
+		static void countUniformUpload();
+		
+		//Forget everything, so the next call of each kind goes to OpenGL
+		static void invalidate();
+		
+		static const Counters& counters();
+		static void resetCounters();
+		
+		//Report OpenGL errors as they happen through KHR_debug, instead of polling glGetError()
+		//Only does anything when built with OPENGL_DEBUG, and only if the driver has the extension
+		static void enableDebugOutput();
+	
+	private:
+		//Whether a cached value needs changing, counting either way
+		template<typename T>
+		static bool change(T& cached, const T& value);
+		
+		//Index of a capability in m_enabled, or -1 if it isn't remembered
+		static int capabilityIndex(GLenum capability);
+		//Index of a texture target in a unit's bindings, or -1 if it isn't remembered
+		static int textureTargetIndex(GLenum target);
+		
+		//Nothing OpenGL will ever use, so whatever's set first is always sent
+		static const GLuint UNKNOWN = ~0u;
+		
+		struct UniformRange {
+			GLuint buffer;
+			GLintptr offset;
+			GLsizeiptr size;
+		};
+		
+		static GLuint m_program;
+		static GLuint m_vao;
+		static GLuint m_arrayBuffer;
+		static GLuint m_elementBuffer;
+		static GLuint m_uniformBuffer;
+		static UniformRange m_uniformRanges[GL_STATE_UNIFORM_BINDINGS];
+		static GLenum m_activeUnit;
+		static GLuint m_textures[GL_STATE_TEXTURE_UNITS][2]; //GL_TEXTURE_2D and GL_TEXTURE_2D_ARRAY
+		static GLuint m_drawFramebuffer;
+		static GLuint m_readFramebuffer;
+		static GLint m_viewport[4];
+		static GLuint m_enabled[3]; //GL_TRUE, GL_FALSE, or UNKNOWN
+		static GLenum m_depthFunc;
+		static GLenum m_cullFace;
+		static GLenum m_blendFunc[2];
+		
+		static Counters m_counters;
+};
+
+#endif /* GL_STATE_H */
@@ -10,6 +10,10 @@
 #include "Menu.h"
 #include "camera.h"
 #include "gameworldctx.h"
+#include "uniform_buffer.h"
+#include "render_queue.h"
+#include "frustum.h"
+#include "frame_arena.h"
 
 #define LIGHT_POINT 1
 #define LIGHT_SPOT  2
@@ -28,7 +32,7 @@ class Graphics {
 			float angle;                //How wide of a cone - for spot lights
 		};
 		
-		Graphics(Menu& menu, const int& w, const int& h, GameWorld::ctx *gwc);
+		Graphics(Menu& menu, const int& w, const int& h, GameWorld::ctx *gwc, PhysicsWorld* physWorld);
 		~Graphics();
 		
 		void addLight(LightContext* light);
@@ -45,8 +49,14 @@ class Graphics {
 		//Return pointer to vector of objects
 		vector<Object *> *getObject();
 		
+		//Find the pickable object under a point on the screen, and where on it the point is
+		//location is relative to the object's centre, in world space - what PhysicsWorld::applyImpulse() takes
+		//Casts a ray through the physics world, unless the menu asks for GPU picking
 		Object* getObjectOnScreen(int x, int y, glm::vec3* location = nullptr);
 		
+		//Draw an object brighter, e.g. because it's under the mouse. nullptr for none
+		void setHighlighted(Object* object);
+		
 		void updateScreenSize(int width, int height);
 
 		Camera * getCamView();
@@ -66,18 +76,90 @@ class Graphics {
 			float a;
 		};
 		
+		//Objects which share a model and shaders, drawn with one instanced call per mesh
+		struct InstanceGroup {
+			std::vector<Object*> objects;
+			Model* model;
+			TextureArray* textures;             //Layer i is the texture of objects[i]
+			
+			GLuint instanceBuffer;
+			std::vector<GLuint> vaos;           //One per mesh of the model, see Model::initInstancedGL()
+			std::vector<GLuint> depthVaos;      //Same, but only reading positions for shadow and picking passes
+			std::vector<InstanceData> instances; //What was last sent to instanceBuffer
+			float screenSize;                   //Largest Object::ScreenSize() of those instances, for picking a level of detail
+		};
+		
+		std::vector<InstanceGroup> instanceGroups;
+		
+		//Find objects which can be drawn together - call before initialising the objects
+		void buildInstanceGroups();
+		//Send the current matrices of a group's objects to its instance buffer, returning how many were sent
+		//Objects outside frustum are left out, if there is one
+		GLsizei updateInstances(InstanceGroup& group, bool pickableOnly, const Frustum* frustum = nullptr);
+		
+		//Enable a lit shader
+		//Compiles it first if this is the first time it's been used
+		void useShader(Shader* shader);
+		
+		//Shadow samples for the current shadow quality, which picks the variant of every lit shader
+		unsigned shadowSamples() const;
+		
+		//The shader to draw with this frame - wanted if it's finished compiling, otherwise the unlit fallback
+		//Starts compiling wanted if it hasn't been already
+		Shader* readyShader(Shader* wanted, const ShaderFeatures& features, bool instanced);
+		//Compiles that can still be waited on this frame, when the driver can't compile in the background
+		int compileBudget = 0;
+		
+		//Substituted into every shader - the number of lights
+		std::unordered_map<std::string, std::string> shaderDictionary;
+		
+		//Fill the FrameData uniform block - lights, camera, and shadow settings
+		void updateFrameUniforms();
+		//Fill the ObjectData uniform block of every object - block i is for worldObjects[i]
+		void updateObjectUniforms();
+		
+		UniformBuffer* frameUniforms = nullptr;
+		UniformBuffer* objectUniforms = nullptr;
+		
+		//Transient arrays for the frame being rendered - reset at the start of Render()
+		FrameArena frameArena;
+		
+		//Draws of the main and shadow passes, sorted to cut down on state changes
+		RenderQueue mainQueue;
+		RenderQueue shadowQueue;       //Dynamic shadow casters, drawn on top of the cached static ones
+		RenderQueue staticShadowQueue; //Everything that doesn't move on its own
+		
+		//Fill mainQueue with every object and instance group the camera can see, sorted by shader, textures, model, then distance
+		void queueMainPass();
+		//Fill shadowQueue and staticShadowQueue - every light draws with the same shaders, so this is done once per frame
+		//Objects are culled against each light's frustum while drawing
+		void queueShadowPass();
+		//Draw a shadow queue into whatever layer is attached, for one light
+		void drawShadowQueue(const RenderQueue& queue, unsigned light);
+		
+		//Filled in Update(), before Render() starts the frame's arena, so this keeps its own storage
+		//clear() keeps the capacity, so it stops allocating after the first few frames
 		std::vector<pair<glm::vec3, Texture*>> billboards;
 
 		// The camera view
 		Camera *camView = nullptr;
-		std::string ErrorString(GLenum error);
 
 		Menu& m_menu;
 		
 		//Render pass for mouse picking
 		void renderPick();
+		//getObjectOnScreen() by rendering object ids and reading one back - stalls until the GPU catches up, so debug only
+		Object* getObjectOnScreenGL(int x, int y, glm::vec3* location);
+		
+		PhysicsWorld* physWorld;
+		std::vector<PhysicsWorld::RayHit> rayHits; //Kept between picks to save reallocating
+		
+		Object* highlighted = nullptr;
 		//Render pass for shadow mapping
+		//Static casters are cached per light, and nothing is drawn if nothing moved
 		void renderShadows();
+		//Size a depth texture array for every light's shadow map
+		void allocateShadowTexture(GLuint texture);
 		void renderBillboards();
 
 		const int& windowWidth;
@@ -90,10 +172,18 @@ class Graphics {
 		
 		GLuint spotlightShadowBuffer;
 		GLuint spotlightShadowTexture;
+		//Depth of only the static casters, copied into spotlightShadowTexture before the dynamic casters are drawn
+		GLuint staticShadowBuffer;
+		GLuint staticShadowTexture;
+		std::vector<glm::mat4> staticShadowMatrices; //Light matrices each static layer was drawn with
+		std::vector<bool> staticShadowValid;         //Whether each static layer is still up to date
+		std::vector<bool> shadowValid;               //Whether each layer of spotlightShadowTexture is still up to date
 		std::vector<glm::mat4> spotlightMatrices; //View-Projection matrices for each light
 		
 		Shader* pickShader;
 		Shader* shadowShader;
+		//Cheap to compile, and compiled at startup - drawn with while a lit shader is still compiling
+		Shader* fallbackShader;
 };
 
 #endif /* GRAPHICS_H */
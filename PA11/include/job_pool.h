@@ -0,0 +1,47 @@
+#ifndef JOB_POOL_H
+#define JOB_POOL_H
+
+#include <vector>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <functional>
+#include <memory>
+
+//A fixed set of worker threads which run jobs in the order they're submitted
+class JobPool {
+	public:
+		//threads = 0 uses one thread per core
+		JobPool(unsigned threads = 0);
+		//Finishes every job already submitted before returning
+		~JobPool();
+		
+		//Run job on a worker, with its result (or exception) delivered through the future
+		template<typename T>
+		std::future<T> submit(std::function<T()> job) {
+			std::shared_ptr<std::packaged_task<T()>> task = std::make_shared<std::packaged_task<T()>>(job);
+			std::future<T> result = task->get_future();
+			
+			push(std::bind(&std::packaged_task<T()>::operator(), task));
+			
+			return result;
+		}
+		
+		unsigned size() const;
+		
+	private:
+		void push(std::function<void()> job);
+		//What each worker thread runs
+		void work();
+		
+		std::vector<std::thread> m_workers;
+		std::deque<std::function<void()>> m_jobs;
+		
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		bool m_stopping;
+};
+
+#endif /* JOB_POOL_H */
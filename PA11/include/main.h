@@ -7,6 +7,7 @@
 #include "json.h"
 #include "engine.h"
 #include "model.h"
+#include "asset_loader.h"
 #include "gameworldctx.h"
 #include "graphics_headers.h"
 
@@ -16,8 +17,10 @@ using json = nlohmann::json;
 
 //Take all the information in the config file, and stuff it into where it needs to go
 int processConfig(int argc, char **argv, json& config, Engine::Context &ctx);
+//Start loading the models and textures an object needs
+void requestObjectAssets(json &config, AssetLoader& loader);
 //Load an object's data
-int loadObjectContext(json &config, Object::Context &ctx, Shader* defaultShader, Shader* defaultAltShader, PhysicsWorld *physWorld);
+int loadObjectContext(json &config, Object::Context &ctx, Shader* defaultShader, Shader* defaultAltShader, PhysicsWorld *physWorld, AssetLoader& loader);
 int loadLightContext(json &config, Graphics::LightContext &ctx, const std::vector<Object*>& objects);
 //Display help menu
 void helpMenu();
\ No newline at end of file
@@ -0,0 +1,34 @@
+#ifndef MAPPED_FILE_H
+#define MAPPED_FILE_H
+
+#include <string>
+#include <cstddef>
+#include <cstdint>
+
+//A whole file mapped read-only into memory
+class MappedFile {
+	public:
+		MappedFile();
+		~MappedFile();
+		
+		//Map a file, unmapping whatever was mapped before
+		//Returns false if the file couldn't be opened or mapped
+		bool open(const std::string& filename);
+		void close();
+		
+		const unsigned char* data() const;
+		size_t size() const;
+		
+		//FNV-1a hash of the file's contents
+		uint64_t hash() const;
+		
+	private:
+		//Copying would unmap the file twice
+		MappedFile(const MappedFile&);
+		MappedFile& operator=(const MappedFile&);
+		
+		unsigned char* m_data;
+		size_t m_size;
+};
+
+#endif /* MAPPED_FILE_H */
@@ -0,0 +1,69 @@
+#ifndef MESH_CACHE_H
+#define MESH_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "model.h"
+#include "mapped_file.h"
+
+//Cache files sit next to their model, with this added to the name
+#define MESH_CACHE_EXTENSION ".meshcache"
+#define MESH_CACHE_MAGIC     0x48534D42 //"BMSH"
+//Bump this whenever the file layout, Vertex, or what's done to meshes on import changes
+#define MESH_CACHE_VERSION   4
+//MaterialFile::time of a material library which couldn't be found
+#define MESH_CACHE_MISSING_FILE -1
+
+//Imported meshes saved in a binary file, so later runs can skip Assimp
+//Layout: MeshCache::Header, then a MeshCache::MaterialFile and its name for each material library the model uses,
+//then for each mesh a MeshCache::MeshHeader followed by its vertices, indices, LODs, and LOD indices
+//The cache is out of date once the model or any of its material libraries changes
+class MeshCache {
+	public:
+		//Fill meshes and bounds from the cache of a model file
+		//Returns false if there's no cache, or it's out of date - the model should be imported normally then
+		static bool read(const std::string& modelFile, std::vector<Mesh>& meshes, Bounds& bounds);
+		//Save imported meshes for next time. Failing to write isn't an error - the cache is just skipped
+		static bool write(const std::string& modelFile, const std::vector<Mesh>& meshes, const Bounds& bounds);
+		
+	private:
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t vertexSize;  //sizeof(Vertex) when written
+			uint32_t meshCount;
+			int64_t sourceTime;   //Modification time of the model file
+			uint64_t sourceSize;
+			uint64_t sourceHash;  //Checked when the time doesn't match, so touching a file doesn't invalidate it
+			float bounds[10];     //min, max, center, radius
+			uint64_t materialFileCount;
+		};
+		
+		//A material library the model names with mtllib, checked the same way as the model
+		//Followed by its name, padded out to a multiple of 8 bytes
+		struct MaterialFile {
+			int64_t time;         //MESH_CACHE_MISSING_FILE if it didn't exist, which Assimp allows
+			uint64_t size;
+			uint64_t hash;
+			uint64_t nameLength;
+		};
+		
+		struct MeshHeader {
+			uint32_t vertexCount;
+			uint32_t indexCount;
+			uint32_t lodCount;
+			uint32_t lodIndexCount;
+			float material[10];   //ambient, diffuse, specular, shininess
+		};
+		
+		//Get the details of a model file to compare against a cache
+		static bool describeSource(const std::string& modelFile, Header& header);
+		//Every material library named in a model, relative to where the program runs like the model's name is
+		static std::vector<std::string> findMaterialFiles(const std::string& modelFile, const MappedFile& source);
+		//Get the details of a material library to compare against a cache. The hash is only filled in if withHash is set
+		static void describeMaterialFile(const std::string& materialFile, bool withHash, MaterialFile& description);
+};
+
+#endif /* MESH_CACHE_H */
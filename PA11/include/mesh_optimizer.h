@@ -0,0 +1,48 @@
+#ifndef MESH_OPTIMIZER_H
+#define MESH_OPTIMIZER_H
+
+#include <vector>
+#include <string>
+
+#include "model.h"
+
+//Size of the cache triangles are ordered for - a little bigger than most hardware, which is fine
+#define MESH_OPTIMIZER_CACHE_SIZE 32
+//Size of the FIFO cache ACMR is measured with, which is closer to real hardware
+#define MESH_OPTIMIZER_FIFO_SIZE 16
+//How much worse ACMR may get when clustering triangles to reduce overdraw
+#define MESH_OPTIMIZER_OVERDRAW_THRESHOLD 1.05f
+
+//Reorders imported meshes so the GPU does less work drawing them
+//Only run on import - the results are stored in the mesh cache
+class MeshOptimizer {
+	public:
+		//Run every step below on a mesh, printing ACMR before and after
+		//overdraw also clusters triangles so ones facing out are drawn first
+		static void optimize(const std::string& name, Mesh& mesh, bool overdraw);
+		
+		//Average cache miss ratio - vertices transformed per triangle with a FIFO cache
+		//Between 0.5 for a perfect order and 3 for no reuse at all
+		static float acmr(const std::vector<unsigned int>& indices, unsigned vertexCount);
+		
+		//Reorder triangles so vertices are reused while they're still in the post-transform cache
+		//Uses Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+		static void optimizeVertexCache(std::vector<unsigned int>& indices, unsigned vertexCount);
+		//Reorder clusters of triangles so the ones facing outwards are drawn first
+		//Clusters are split where the cache would be emptied anyway, and the order is only kept if ACMR stays within threshold
+		static void optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold);
+		//Reorder vertices into the order they're first used, dropping any that aren't
+		static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices);
+		
+	private:
+		struct Cluster {
+			unsigned start; //First index of the cluster
+			unsigned end;
+			float sortKey;  //Higher is drawn first
+		};
+		
+		static float vertexScore(int cachePosition, unsigned remainingTriangles);
+		static bool compareClusters(const Cluster& a, const Cluster& b);
+};
+
+#endif /* MESH_OPTIMIZER_H */
@@ -0,0 +1,54 @@
+#ifndef MESH_SIMPLIFIER_H
+#define MESH_SIMPLIFIER_H
+
+#include <vector>
+
+#include "model.h"
+
+//Triangles kept by each LOD level after the first, as a fraction of the level before it
+#define MESH_SIMPLIFIER_LOD_RATIO 0.5f
+//Stop adding levels once simplifying can't get below this fraction of the level before
+#define MESH_SIMPLIFIER_MIN_REDUCTION 0.8f
+//Largest error allowed for any collapse, as a fraction of the mesh's size
+#define MESH_SIMPLIFIER_MAX_ERROR 0.05f
+//Most collapse passes to try per level - each pass collapses many edges at once
+#define MESH_SIMPLIFIER_MAX_PASSES 32
+
+//Builds lower detail index lists for a mesh by collapsing edges with the least quadric error
+//(Garland and Heckbert, "Surface Simplification Using Quadric Error Metrics")
+//Vertices only ever collapse onto other existing vertices, so every level shares the mesh's vertex buffer
+//Vertices on UV seams or open edges never move, so seams and silhouettes stay intact
+class MeshSimplifier {
+	public:
+		//Add up to levels LODs after the first to a mesh, each with about half the triangles of the last
+		static void generateLODs(Mesh& mesh, unsigned levels);
+		
+		//Collapse edges in indices until there are at most targetIndexCount indices, or nothing more can go
+		//maxError is the largest squared distance any vertex may move off its original surface
+		static void simplify(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned targetIndexCount, float maxError);
+		
+	private:
+		//Sum of squared distances to a set of planes, as a symmetric 4x4 matrix
+		struct Quadric {
+			float a00, a01, a02, a11, a12, a22; //The plane normals
+			float b0, b1, b2;                   //Normal times distance
+			float c;                            //Distance squared
+		};
+		
+		struct Collapse {
+			unsigned from;
+			unsigned to;
+			float error;
+		};
+		
+		static void addPlane(Quadric& quadric, const glm::vec3& normal, float distance, float weight);
+		static void addQuadric(Quadric& quadric, const Quadric& other);
+		static float quadricError(const Quadric& quadric, const glm::vec3& point);
+		
+		//Whether moving from onto to would flip any of from's triangles over
+		static bool flipsTriangle(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<unsigned>& triangles, unsigned from, unsigned to);
+		
+		static bool compareCollapses(const Collapse& a, const Collapse& b);
+};
+
+#endif /* MESH_SIMPLIFIER_H */
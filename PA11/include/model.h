@@ -6,11 +6,17 @@
 #define MODEL_H
 
 #include <string>
+#include <cstring>
 #include <fstream>
 #include <vector>
+#include <cstdint>
 #include <unordered_map>
+#include <mutex>
+#include <atomic>
 
 #include "graphics_headers.h"
+#include "uniform_buffer.h"
+#include "texture_cache.h"
 #include <shader.h>
 
 //Set up which texture channels to use with which type of texture
@@ -28,6 +34,13 @@
 #define GL_SPECULAR_TEXTURE_OFFSET 4
 #define GL_SHADOW_TEXTURE_OFFSET   5
 
+//Trilinear filtering between the mip levels of every texture
+#define TEXTURE_MIN_FILTER GL_LINEAR_MIPMAP_LINEAR
+#define TEXTURE_MAG_FILTER GL_LINEAR
+
+//How many lower detail levels Model::load() tries to make for each mesh
+#define MODEL_LOD_LEVELS 3
+
 struct Material {
 	glm::vec3 ambient = {0.2, 0.2, 0.2};  //Ka
 	glm::vec3 diffuse = {0.8, 0.8, 0.8};  //Kd
@@ -36,63 +49,198 @@ struct Material {
 	float shininess = 0.0f;               //Ns
 };
 
+//Which indices of a mesh's index buffer draw one level of detail
+struct MeshLOD {
+	unsigned offset;
+	unsigned count;
+};
+
 struct Mesh {
 	std::vector<Vertex> _vertices;
-	std::vector<unsigned int> _indices;
+	std::vector<unsigned int> _indices;    //Full detail, which is also what physics uses
+	std::vector<unsigned int> _lodIndices; //Every lower detail level, one after the other
+	std::vector<MeshLOD> lods;             //Full detail first, then each level in _lodIndices
 	Material material;
 	
 	//OpenGL buffers
-	GLuint VB;
+	GLuint positionVB; //Just positions, for every pass
+	GLuint VB;         //PackedVertex for everything else, only read when shading
 	GLuint IB;
+	GLenum indexType;  //GL_UNSIGNED_SHORT when the mesh is small enough, otherwise GL_UNSIGNED_INT
+	//Vertex array objects - remember the attribute layout and buffers above so drawing is just a bind
+	GLuint VAO;        //Every attribute
+	GLuint depthVAO;   //Only positions, for passes that just need depth
+};
+
+//The attributes of a Vertex besides its position, packed for OpenGL - see Model::packVertex()
+struct PackedVertex {
+	uint16_t uv[2];   //Half floats, attribute location 1
+	uint32_t normal;  //Signed 10:10:10:2, attribute location 2
+	uint32_t tangent; //Signed 10:10:10:2 with the bitangent's handedness in w, attribute location 3
+};
+
+//Extents of a model, in model space
+struct Bounds {
+	glm::vec3 min = {0.0, 0.0, 0.0};    //Corners of the bounding box
+	glm::vec3 max = {0.0, 0.0, 0.0};
+	glm::vec3 center = {0.0, 0.0, 0.0}; //Bounding sphere
+	float radius = 0.0f;
+};
+
+//Per-instance data for instanced draws - see Model::initInstancedGL()
+struct InstanceData {
+	glm::mat4 model; //Model matrix, attribute locations 5-8
+	float layer;     //Layer of the group's texture array, attribute location 9
+	float id;        //Object id for picking, attribute location 10
+	float highlight; //1 if the object is under the mouse, attribute location 11
 };
 
 class Model {
 	public:
 		//Load a model from a file
+		//Safe from several threads at once - every call for the same file gets the same Model, imported once
 		static Model* load(std::string filename);
 		
 		std::vector<Mesh> meshes;
+		//Box and sphere around every mesh
+		Bounds bounds;
 		
 		//Initalise OpenGL
 		//Call after starting OpenGL, but before using drawModel()
 		void initGL();
 		//Draw the model to the screen
-		void drawModel(Shader* shader);
+		//lod picks a level of detail from selectLOD() - meshes without that many levels use their lowest
+		//The last mesh's VAO is left bound, so drawing the same model again doesn't rebind it
+		void drawModel(Shader* shader, unsigned lod = 0);
+		//Draw the model with nothing but its positions, for shadow and picking passes
+		void drawModelDepth(unsigned lod = 0);
+		
+		//Build a VAO for each mesh which also reads InstanceData from instanceBuffer
+		//depthOnly VAOs only read positions, like drawModelDepth()
+		//Call after initGL()
+		std::vector<GLuint> initInstancedGL(GLuint instanceBuffer, bool depthOnly = false);
+		//Draw count instances of the model using VAOs from initInstancedGL()
+		void drawModelInstanced(Shader* shader, const std::vector<GLuint>& vaos, GLsizei count, unsigned lod = 0);
+		
+		//Pick a level of detail for something screenSize big on screen - see Object::ScreenSize()
+		//Shadow passes drop detail sooner, since nobody looks closely at a shadow
+		static unsigned selectLOD(float screenSize, bool shadow);
+		//Multiplies every screen size before picking a level - higher keeps full detail further away
+		//Set from "lod-bias" in the config
+		static float lodBias;
+		
+		//Small number unique to this model, for sorting draws
+		unsigned getSortID() const;
 		
 	protected:
 		Model();
 		
+		//Bind a mesh's buffers and describe its vertex layout to the currently bound VAO
+		//depthOnly leaves out everything but the position
+		static void bindMeshAttributes(Mesh& mesh, bool depthOnly);
+		
+		//Where a level of detail starts in a mesh's index buffer
+		static const GLvoid* indexOffset(const Mesh& mesh, const MeshLOD& lod);
+		
+		//Read a model from its cache or with Assimp, for load()
+		static Model* import(const std::string& filename);
+		
+		static PackedVertex packVertex(const Vertex& vertex);
+		//Pack a vector with components from -1 to 1 into GL_INT_2_10_10_10_REV
+		//w should be -1 or 1, and reads back as exactly that on any OpenGL version
+		static uint32_t packSigned1010102(const glm::vec4& vector);
+		
 		static void loadVertices(aiMesh *mesh, Mesh *newModel);
 		static void loadIndices(aiMesh *mesh, Mesh *newModel);
 		static Material loadMaterials(const aiScene *scene, int meshIndex);
+		static Bounds computeBounds(const std::vector<Mesh>& meshes);
+		
+		//Smallest screen size each level after the first is used down to, for normal and shadow passes
+		static const float lodScreenSizes[MODEL_LOD_LEVELS];
+		static const float shadowLODScreenSizes[MODEL_LOD_LEVELS];
 		
 		//Keeps track of whether of not initGL() has been called yet
 		bool initialised;
+		
+		//MaterialData uniform block of each mesh
+		UniformBuffer* materialUniforms;
+		
+		unsigned sortID;
+		static std::atomic<unsigned> sortIDCounter; //Models and textures are created on loader threads
 };
 
 class Texture {
 	public:
 		//Load texture from file
-		static Texture* load(std::string filename);
+		//Normal maps are compressed differently, keeping only X and Y - the shader has to rebuild Z
+		//Safe from several threads at once - every call for the same file gets the same Texture, decoded once
+		static Texture* load(std::string filename, bool normalMap = false);
 		
 		//Initalise OpenGL
 		//Call after starting OpenGL, but before using bind()
 		void initGL();
 		//Bind the texture for use
 		void bind(GLenum textureTarget);
+		//Let go of the mip chain without sending it to OpenGL, for textures only drawn through a TextureArray
+		//Does nothing once initGL() has been called
+		void releaseData();
+		
+		//Small number unique to this texture, for sorting draws
+		unsigned getSortID() const;
 		
 	private:
+		friend class TextureArray;
+		
 		Texture();
 		
+		//Read a texture from its cache or with ImageMagick, for load()
+		static Texture* decode(const std::string& filename, bool normalMap);
+		
+		unsigned sortID;
+		static std::atomic<unsigned> sortIDCounter; //Models and textures are created on loader threads
+		
+		//Keeps track of whether of not initGL() has been called yet
+		bool initialised;
+		
+		//OpenGL texture location
+		GLuint m_textureObj;
+		
+		//Every mip level, either in m_mapping (from the cache) or m_pixels (just decoded)
+		//Both are let go once OpenGL or every TextureArray using it has its own copy
+		TextureCache::Image m_image;
+		MappedFile m_mapping;
+		std::vector<unsigned char> m_pixels;
+};
+
+//Several same-sized textures stacked into one GL_TEXTURE_2D_ARRAY, for instanced draws
+class TextureArray {
+	public:
+		//Stack textures into layers, in the given order
+		//The textures must all be loaded, but not yet initialised, and must all be the same size
+		static TextureArray* create(const std::vector<Texture*>& layers);
+		
+		//Initalise OpenGL
+		//Call after starting OpenGL, but before using bind()
+		void initGL();
+		//Bind the texture array for use
+		void bind(GLenum textureTarget);
+		
+	private:
+		TextureArray();
+		
 		//Keeps track of whether of not initGL() has been called yet
 		bool initialised;
 		
 		//OpenGL texture location
 		GLuint m_textureObj;
 		
-		//ImageMagick data
-		Magick::Image* m_Image;
-		Magick::Blob* m_Blob;
+		unsigned m_layers;
+		//Format shared by every layer
+		uint32_t m_format;
+		//Size of each mip level, for one layer
+		std::vector<TextureCache::Level> m_levels;
+		//RGBA data for each mip level, with every layer one after the other
+		std::vector<std::vector<unsigned char>> m_data;
 };
 #endif //TUTORIAL_MODEL_H
 
@@ -10,8 +10,11 @@
 #include "shader.h"
 #include "Menu.h"
 
+//How far any part of the model matrix has to change for a planet to count as having moved
+#define OBJECT_MOVE_EPSILON 1e-4f
 
 class Menu;
+class PhysicsWorld;
 class Model;
 class Texture;
 class Shader;
@@ -52,6 +55,8 @@ class Object {
 			int rigidBodyIndex = 0;
 			
 			int expansionTimer = 0;
+			
+			int instanceGroup = -1; //Which of Graphics' instance groups draws this object, if any
 		};
 		
 		Object(const Context& ctx);
@@ -59,21 +64,43 @@ class Object {
 		~Object();
 		
 		//Initialises the planet's model and textures for OpenGL
-		void Init_GL(std::unordered_map<std::string, std::string> const* dictionary = nullptr);
+		//Shaders are left to Graphics, since which variant gets used depends on the settings
+		void Init_GL();
 		
-		//Updates the physics for the planet
+		//Moves the planet to where the physics thread has its body this frame
 		void Update(float dt);
 		
+		//The shader features matching the planet's textures and the shadow quality
+		ShaderFeatures Features(unsigned shadowSamples) const;
+		//The variant of the planet's current shader with those features
+		Shader* GetShader(unsigned shadowSamples) const;
+		
 		//Renders the planet on the screen
-		void Render(bool withShadows, std::vector<glm::mat4> spotlightMatrices) const;
+		//Its ObjectData uniform block should already be bound, and shader (from GetShader()) enabled
+		//bindTextures can be false when the last object drawn with the same shader had the same textures
+		void Render(Shader* shader, bool bindTextures = true) const;
+		
+		//Whether two planets draw with exactly the same textures
+		bool SameTextures(const Object* other) const;
 		
 		void RenderID(Shader* shader) const;
 		
-		void RenderShadow(Shader* shader, const glm::mat4& lightMatrix) const;
+		//Renders the planet into a shadow map
+		//Its ObjectData uniform block should already be bound
+		void RenderShadow() const;
+		
+		//How big the planet looks from the camera - its bounding sphere's projected radius, as a fraction of half the screen height
+		//Used to pick a level of detail with Model::selectLOD()
+		float ScreenSize() const;
 		
 		//Returns the current model matrix of this planet
 		const glm::mat4& GetModel() const;
 		
+		//Whether the planet was given the "dynamic" flag - anything else never moves on its own
+		bool IsDynamic() const;
+		//Whether the model matrix changed in the last Update()
+		bool Moved() const;
+		
 		//The current properties of this planet
 		Context ctx;
 		//The properties the planet started with, for reset purposes
@@ -81,20 +108,30 @@ class Object {
 		
 		//Where in the world the planet is
 		const glm::vec3& position;
+		//Sphere around the planet in world space, for culling
+		const glm::vec3& boundCenter;
+		const float& boundRadius;
 		
 		static glm::mat4* viewMatrix;
 		static glm::mat4* projectionMatrix;
 		
 		static Menu* menu;
+		//Where Update() gets each body's transform from
+		static PhysicsWorld* physics;
 	
 	protected:
 		//OpenGL information for rendering
 		glm::mat4 modelMat;
 		
 		glm::vec3 _position;
+		glm::vec3 _boundCenter;
+		float _boundRadius;
 		
 		bool doOffset;
 		
+		bool dynamic;
+		bool moved;
+		
 		static int idCounter;
 };
 
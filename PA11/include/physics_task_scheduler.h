@@ -0,0 +1,75 @@
+#ifndef PHYSICS_TASK_SCHEDULER_H
+#define PHYSICS_TASK_SCHEDULER_H
+
+#ifdef BULLET_MULTITHREADED
+
+#include <vector>
+#include <future>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <LinearMath/btThreads.h>
+
+#include "job_pool.h"
+
+//Runs Bullet's parallel loops on a JobPool, for btDiscreteDynamicsWorldMt
+//Each of the pool's threads gets one job which waits for loops until the scheduler is gone, so handing one out never allocates
+//The thread calling a loop takes a share of it too, rather than waiting idle
+class PhysicsTaskScheduler : public btITaskScheduler {
+	public:
+		//Takes over every thread in pool until it's destroyed
+		PhysicsTaskScheduler(JobPool& pool);
+		~PhysicsTaskScheduler();
+		
+		//Bullet numbers threads in the order they first call into it, and sizes its per-thread arrays by these
+		//Only the thread stepping the world and the pool's threads ever call in, so that thread has to install the scheduler
+		int getMaxNumThreads() const override;
+		int getNumThreads() const override;
+		//Split loops across fewer of the pool's threads, down to 1 for just the stepping thread
+		void setNumThreads(int numThreads) override;
+		
+		void parallelFor(int begin, int end, int grainSize, const btIParallelForBody& body) override;
+		btScalar parallelSum(int begin, int end, int grainSize, const btIParallelSumBody& body) override;
+		
+	private:
+		//How many pieces to split a loop into - 1 means just run it here
+		int chunkCount(int begin, int end, int grainSize) const;
+		//Split a loop into pieces and run them, returning once every one is done
+		//Only one of forBody and sumBody is set
+		void runLoop(int begin, int end, int chunks, const btIParallelForBody* forBody, const btIParallelSumBody* sumBody);
+		//Take pieces of the current loop until there are none left
+		void runChunks();
+		//The job each of the pool's threads runs
+		void work();
+		
+		JobPool& m_pool;
+		std::vector<std::future<void>> m_workers;
+		int m_threads;
+		
+		//Set during a loop, so loops started from inside one just run on their own thread
+		std::atomic<bool> m_busy;
+		
+		//Workers wait for m_loop to change, then the ones Bullet numbered below m_participants take part
+		std::mutex m_mutex;
+		std::condition_variable m_wake;
+		unsigned m_loop;
+		int m_participants;
+		bool m_stopping;
+		
+		//The current loop, which is only changed once every worker taking part has finished it
+		const btIParallelForBody* m_forBody;
+		const btIParallelSumBody* m_sumBody;
+		int m_begin;
+		int m_end;
+		int m_chunkSize;
+		int m_chunkCount;
+		std::atomic<int> m_nextChunk;
+		//Workers taking part that haven't finished yet
+		std::atomic<int> m_pending;
+		//Each piece's result for parallelSum, sized for the most pieces a loop can have
+		std::vector<btScalar> m_sums;
+};
+
+#endif /* BULLET_MULTITHREADED */
+
+#endif /* PHYSICS_TASK_SCHEDULER_H */
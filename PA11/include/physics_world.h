@@ -4,12 +4,33 @@
 
 #include <btBulletDynamicsCommon.h>
 #include <map>
+#include <tuple>
 #include <unordered_map>
 #include <string>
 #include <vector>
 #include <functional>
+#include <algorithm>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 #include "graphics_headers.h"
 #include "gameworldctx.h"
+#include "spsc_queue.h"
+#include "job_pool.h"
+#include "physics_task_scheduler.h"
+
+//Bullet is stepped this many times a second on its own thread, however fast frames are drawn
+#define PHYSICS_STEP_RATE 240
+//How many steps the physics thread will run back to back to catch up, before it gives up on the lost time
+#define PHYSICS_MAX_CATCH_UP 8
+//Commands which can be waiting for the physics thread at once
+#define PHYSICS_COMMAND_QUEUE_SIZE 256
+//Set in m_readyIndex when the snapshot there hasn't been taken by the render thread yet
+#define PHYSICS_SNAPSHOT_FRESH 4u
+//Steps timed by --benchmark-physics, 10 seconds of play
+#define PHYSICS_BENCHMARK_STEPS (PHYSICS_STEP_RATE * 10)
 
 // Collision Types
 #define BIT(x) (1<<(x))
@@ -21,13 +42,24 @@ enum collisiontypes {
 	COL_EVERYTHING_ELSE = 8 //<Collide with everything
 };
 
-// Callback to determine collisions
+// Callback to clamp ball speeds after every step
 static void myTickCallback(btDynamicsWorld *world, btScalar timeStep);
 
 class Object;
+class Model;
+class btITaskScheduler;
+class btConstraintSolverPoolMt;
 
 class PhysicsWorld {
 	public:
+		//Where a ray went through a body
+		struct RayHit {
+			btRigidBody* body;
+			btVector3 point;  //In the world
+			btVector3 offset; //From the body's centre to point, as applyImpulse() takes it
+			float fraction; //How far along the ray, from 0 at the start to 1 at the end
+		};
+		
 		struct Context {
 			double rotationX = 0.0f;
 			double rotationY = 0.0f;
@@ -46,27 +78,140 @@ class PhysicsWorld {
 			float scaleY = 1;
 			float scaleZ = 1;
 			float scale = 1.0f;
+			//The model whose triangles make up the body, when it isn't one of the shapes above
+			const Model* mesh = nullptr;
+			btVector3 meshScale = btVector3(1, 1, 1);
+			//Where mesh was loaded from, so its BVH can be cached next to it
+			std::string meshFile;
 			
 			std::vector<std::string>* flags;
 
 			btRigidBody* physicsBody;
 		};
 		
-		PhysicsWorld();
+		//Where a body was after a step, as the render thread sees it
+		struct BodyState {
+			btVector3 origin;
+			btQuaternion rotation;
+			btVector3 velocity;
+		};
+		
+		//Something for the physics thread to do to a body before its next step
+		struct Command {
+			enum Type {
+				IMPULSE, //Push the body by vector, at point
+				PLACE    //Move the body to vector, unrotated and at rest
+			};
+			
+			Type type;
+			int body;
+			btVector3 vector;
+			btVector3 point;
+		};
+		
+		//multithreaded uses btDiscreteDynamicsWorldMt, which needs a build with BULLET_MULTITHREADED
+		//threads counts the physics thread itself, with 0 meaning one per core
+		//The physics thread is started here, but doesn't step anything until start()
+		PhysicsWorld(bool multithreaded = false, unsigned threads = 0);
 		
 		~PhysicsWorld();
 		
 		int addBody(btRigidBody* bodyToAdd);
 		bool addObject(std::string objectName, btTriangleMesh* objTriMesh);
-		int createObject(std::string objectName, btTriangleMesh* objTriMesh, PhysicsWorld::Context* objCtx);
-		void update(float dt);
+		int createObject(std::string objectName, PhysicsWorld::Context* objCtx);
 		std::vector<btRigidBody*>* getLoadedBodies();
+		//Find every body the line from 'from' to 'to' passes through, closest first
+		//Render thread only - bodies are where they're drawn this frame, so it never waits for the physics thread
+		void rayTest(const btVector3& from, const btVector3& to, std::vector<RayHit>& hits);
+		
+		//Start stepping the world on the physics thread, once every body has been created
+		//From then on bodies must only be changed through the commands below
+		void start();
+		//Stop the physics thread for good, letting it finish its current step
+		void stop();
+		void setPaused(bool paused);
+		
+		//Queue a command for the physics thread - only the render thread may call these
+		void applyImpulse(int body, const btVector3& impulse, const btVector3& point);
+		void placeBody(int body, const btVector3& origin);
+		
+		//Take the newest snapshot from the physics thread - call once a frame, before the getters below
+		void updateSnapshot();
+		//Where a body should be drawn this frame, between the last two steps
+		btTransform interpolatedTransform(int body) const;
+		//Where a body was after the newest step
+		const BodyState& bodyState(int body) const;
+		
+		//Check for balls being sunk or coming to rest, and move the game on
+		//Runs on the render thread from the latest snapshot, so the game's state is only ever changed there
+		void updateGame();
+		
+		//Hit a body and time stepping the world for a number of steps, printing how long they took
+		//For comparing the single and multithreaded worlds - must be called before start()
+		//Steps run on the physics thread, so Bullet sees the same threads as it does in play
+		void benchmark(int body, const btVector3& impulse, unsigned steps);
 		
 		std::vector<int> ballIndices;
 		
 		static GameWorld::ctx* game;
 	
 	private:
+		//Every body's state after one step, along with the step before it
+		struct Snapshot {
+			std::vector<BodyState> previous;
+			std::vector<BodyState> current;
+			std::chrono::steady_clock::time_point time; //When current was published
+			unsigned commandsRun = 0;                  //How many commands had been run before it
+		};
+		
+		//What makes two bodies' collision shapes the same, so they can share one
+		struct ShapeKey {
+			int shape;
+			btVector3 size;    //Radius, half extents, plane normal or mesh scale, depending on the shape
+			const Model* mesh; //Only for mesh shapes
+			bool dynamic;      //Moving meshes need a different shape to static ones
+			bool exact;        //Moving meshes which keep every triangle rather than being simplified
+			
+			bool operator<(const ShapeKey& other) const;
+		};
+		
+		//A model's triangles at one scale
+		struct TriangleMeshKey {
+			const Model* mesh;
+			btVector3 scale;
+			
+			bool operator<(const TriangleMeshKey& other) const;
+		};
+		
+		static bool compareRayHits(const RayHit& a, const RayHit& b);
+		
+		//The shape a body described by objCtx should have, made the first time it's asked for
+		btCollisionShape* getShape(const Context& objCtx, bool isDynamic);
+		//A model's triangles scaled for Bullet, made the first time they're asked for
+		btTriangleMesh* getTriangleMesh(const Model* mesh, const btVector3& scale);
+		//A static mesh shape, with its BVH loaded from the cache next to meshFile if it's there, or built and saved there if not
+		btBvhTriangleMeshShape* createStaticMeshShape(const std::string& meshFile, const Model* mesh, const btVector3& scale);
+		
+		//What the physics thread has been asked to do
+		enum ThreadState {
+			THREAD_STARTING,  //Setting Bullet up, before it can be asked anything
+			THREAD_IDLE,      //Waiting for start() or benchmark()
+			THREAD_STEPPING,  //Stepping the world until stop()
+			THREAD_BENCHMARK, //Timing steps for benchmark()
+			THREAD_EXITING
+		};
+		
+		//What the physics thread runs, from taking Bullet's first thread index until stop()
+		void threadMain();
+		//Step the world in time, between start() and stop()
+		void run();
+		//Time m_benchmarkSteps steps back to back, for benchmark()
+		void runBenchmark();
+		//Apply every queued command, returning whether there were any
+		bool runCommands();
+		//Fill the snapshot being written from the bodies and hand it over to the render thread
+		//Bodies which were teleported rather than stepped shouldn't be interpolated
+		void publishSnapshot(bool interpolate);
 
 		// Physics configuration
 		btBroadphaseInterface* broadphase;
@@ -74,10 +219,53 @@ class PhysicsWorld {
 		btCollisionDispatcher* dispatcher;
 		btSequentialImpulseConstraintSolver* solver;
 		btDiscreteDynamicsWorld* dynamicsWorld;
+		
+		//Only set up for the multithreaded world
+		JobPool* m_jobPool;
+		btITaskScheduler* m_taskScheduler;
+		btConstraintSolverPoolMt* m_solverPool;
 
 		// Lists of loaded objects
 		std::vector<btRigidBody*> loadedBodies;
-	
+		
+		//Shared by every body with the same shape, and owned here rather than by the bodies
+		std::map<ShapeKey, btCollisionShape*> m_shapes;
+		std::map<TriangleMeshKey, btTriangleMesh*> m_triangleMeshes;
+		//What BVHs loaded from the cache live in, which their shapes don't free
+		std::vector<void*> m_bvhBuffers;
+		
+		std::thread m_thread;
+		std::atomic<bool> m_running;
+		std::atomic<bool> m_paused;
+		//Only used to hand the physics thread work, never while it's stepping
+		std::mutex m_threadMutex;
+		std::condition_variable m_threadStateChanged;
+		ThreadState m_threadState;
+		unsigned m_benchmarkSteps;
+		
+		//A copy of every body for ray tests on the render thread, moved to the latest snapshot before each one
+		//Shares the bodies' shapes, which nothing changes once the physics thread starts
+		btDefaultCollisionConfiguration* m_pickConfiguration;
+		btCollisionDispatcher* m_pickDispatcher;
+		btBroadphaseInterface* m_pickBroadphase;
+		btCollisionWorld* m_pickWorld;
+		std::vector<btCollisionObject*> m_pickObjects;
+		
+		SPSCQueue<Command, PHYSICS_COMMAND_QUEUE_SIZE> m_commands;
+		unsigned m_commandsSent; //Render thread only
+		unsigned m_commandsRun;  //Physics thread only
+		
+		//Triple buffered, so neither thread ever waits for the other
+		//The physics thread fills m_snapshots[m_writeIndex] and the render thread reads m_snapshots[m_readIndex]
+		//Each swaps its own with m_readyIndex, the newest one not being used by either
+		Snapshot m_snapshots[3];
+		unsigned m_writeIndex;
+		unsigned m_readIndex;
+		std::atomic<unsigned> m_readyIndex;
+		//The physics thread's copy of the last step, which becomes the next snapshot's previous
+		std::vector<BodyState> m_lastStates;
+		//How far this frame is from previous to current, set by updateSnapshot()
+		float m_alpha;
 };
 
 
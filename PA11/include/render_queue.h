@@ -0,0 +1,51 @@
+#ifndef RENDER_QUEUE_H
+#define RENDER_QUEUE_H
+
+#include <algorithm>
+#include <cstdint>
+
+#include "frame_arena.h"
+
+//Which pass a draw belongs to - the most significant part of a sort key
+#define RENDER_PASS_MAIN   0
+#define RENDER_PASS_SHADOW 1
+
+//Draws for a single pass, sorted so that draws sharing state end up next to each other
+//Keys are laid out (most to least significant) as:
+//  pass (4 bits) | program (12 bits) | texture set (16 bits) | model (16 bits) | depth (16 bits)
+//so sorting minimises program switches first, then texture binds, then vertex array binds,
+//and finally draws front to back
+class RenderQueue {
+	public:
+		struct Item {
+			uint64_t key;
+			int object; //Index into the game world's objects, or -1
+			int group;  //Index into Graphics' instance groups, or -1
+		};
+
+		//Build a sort key. depth is 0 at the camera and 1 at the far plane
+		static uint64_t makeKey(unsigned pass, unsigned program, unsigned textures, unsigned model, float depth);
+
+		RenderQueue();
+
+		//Empty the queue, making room for capacity draws in this frame's arena
+		void clear(FrameArena& arena, unsigned capacity);
+		//Add a draw of either an object or an instance group
+		//Draws past the capacity given to clear() are dropped
+		void push(uint64_t key, int object, int group);
+		//Put the draws in submission order
+		void sort();
+
+		//The draws, for range-based for loops
+		const Item* begin() const;
+		const Item* end() const;
+
+	private:
+		static bool compareItems(const Item& a, const Item& b);
+
+		Item* m_items;
+		unsigned m_count;
+		unsigned m_capacity;
+};
+
+#endif /* RENDER_QUEUE_H */
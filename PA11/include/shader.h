@@ -5,42 +5,130 @@
 #include <fstream>
 #include <map>
 #include <unordered_map>
+#include <algorithm>
+#include <cstdint>
 
 #include "graphics_headers.h"
+#include "uniform_buffer.h"
 
 #define SHADER_DIR "shaders/"
 #define SHADER_FILE "shaders/shaderList"
+//Linked programs are saved here, named after a hash of everything that went into them
+#define SHADER_CACHE_DIR "shaders/cache/"
+
+//From KHR_parallel_shader_compile, in case GLEW is too old to have it
+#ifndef GL_COMPLETION_STATUS_KHR
+#define GL_COMPLETION_STATUS_KHR 0x91B1
+#endif
+
+//Every uniform the engine sets outside of uniform blocks
+//Each shader looks all of them up once when it's linked, so setting one is just indexing an array
+enum Uniform {
+	UNIFORM_SAMPLER,                  //gSampler
+	UNIFORM_ALT_SAMPLER,              //gAltSampler
+	UNIFORM_NORMAL_SAMPLER,           //gNormalSampler
+	UNIFORM_SPECULAR_SAMPLER,         //gSpecularSampler
+	UNIFORM_SPOTLIGHT_SHADOW_SAMPLER, //spotlightShadowSampler
+	UNIFORM_MVP,                      //MVP
+	UNIFORM_MODEL,                    //M
+	UNIFORM_ID,                       //id
+	UNIFORM_LIGHT_INDEX,              //lightIndex
+	UNIFORM_ASPECT,                   //aspect
+	UNIFORM_BILLBOARD_LOCATION,       //billboardLocation
+	UNIFORM_COUNT
+};
+
+//Compile-time options for a shader, defined at the top of its source
+//Each combination is compiled as its own variant - see Shader::variant()
+struct ShaderFeatures {
+	bool hasTexture = false;     //HAS_TEXTURE
+	bool hasNormalMap = false;   //HAS_NORMAL_MAP
+	bool hasSpecularMap = false; //HAS_SPECULAR_MAP
+	unsigned shadowSamples = 0;  //SHADOW_SAMPLES, 0 for no shadows
+	
+	//Every feature packed into one number, for telling variants apart
+	uint32_t bits() const;
+	//The #defines for the features
+	std::string defines() const;
+};
 
 class Shader {
 	public:
 		//Initialise Shader in OpenGL - call this after creating OpenGL context but before using shader
+		//Waits for the program to finish compiling
 		bool Initialize(std::unordered_map<std::string, std::string> const * dictionary = nullptr);
+		//Start compiling the program without waiting for it - check on it with IsReady()
+		void InitializeAsync(std::unordered_map<std::string, std::string> const * dictionary = nullptr);
+		//Whether the program has finished compiling, and compiled successfully
+		//Without KHR_parallel_shader_compile there's no asking without waiting, so this is always false unless block is set
+		bool IsReady(bool block = false);
+		//Whether the driver compiles in the background, so IsReady() can be polled without waiting
+		static bool ParallelCompileSupported();
 		//Start using the shader for any render calls
 		void Enable();
 		//Get uniform location from shader
-		GLint GetUniformLocation(const char *pUniformName);
+		//Returns INVALID_UNIFORM_LOCATION if the shader doesn't use it
+		GLint GetUniformLocation(Uniform uniform) const;
 		
 		//Set uniforms within shader
-		bool uniform1fv(const char* uniform, GLsizei size, const GLfloat* value);
-		bool uniform3fv(const char* uniform, GLsizei size, const GLfloat* value);
-		bool uniform1i(const char* uniform, GLint value);
-		bool uniformMatrix4fv(const char* uniform, GLsizei size, GLboolean transpose, const GLfloat* value);
+		//Uniforms the shader doesn't use (or that were optimised away) are skipped without calling OpenGL
+		bool uniform1fv(Uniform uniform, GLsizei size, const GLfloat* value);
+		bool uniform3fv(Uniform uniform, GLsizei size, const GLfloat* value);
+		bool uniform1i(Uniform uniform, GLint value);
+		bool uniformMatrix4fv(Uniform uniform, GLsizei size, GLboolean transpose, const GLfloat* value);
 		
 		//Load a shader from a file
 		static Shader *load(std::string vertexFile, std::string fragmentFile, std::string geometryFile = "");
+		
+		//Get the variant of this shader compiled with INSTANCED_DRAW set, for instanced draws
+		//Still needs Initialize() to be called on it
+		Shader* instanced();
+		//Get the variant of this shader compiled with the given features
+		//Variants are only created once, but each still needs Initialize() to be called on it
+		Shader* variant(const ShaderFeatures& features);
+		
+		//Small number unique to this shader, for sorting draws
+		unsigned GetSortID() const;
 	
 	private:
 		Shader();
 		
 		~Shader();
 		
-		bool AddShader(GLenum ShaderType, const std::string &shader, std::unordered_map<std::string, std::string> const * dictionary = nullptr);
+		//Where one of the engine's uniforms is in the linked program
+		struct UniformInfo {
+			GLint location; //INVALID_UNIFORM_LOCATION if the shader doesn't use it
+			GLint size;     //Number of elements, for arrays
+		};
+		
+		//Fill in dictionary entries and INSTANCED_DRAW
+		std::string Preprocess(const std::string& shader, std::unordered_map<std::string, std::string> const * dictionary) const;
+		bool AddShader(GLenum ShaderType, const std::string &shader);
 		bool Finalize();
+		//Initialising is split in two, so the driver can compile in between
+		void StartCompile(std::unordered_map<std::string, std::string> const * dictionary);
+		bool FinishCompile();
+		//Everything needed after linking, whether from source or a binary
+		bool Configure();
+		
+		//Try loading the program from the binary cache instead of compiling it
+		bool LoadBinary(const std::string& cacheFile);
+		//Save the linked program for next time
+		void SaveBinary(const std::string& cacheFile);
+		//Name of the cache file for some preprocessed sources, also keyed on the driver
+		static std::string BinaryCacheFile(const std::string& vertex, const std::string& fragment, const std::string& geometry);
+		//Fill m_uniforms from the linked program
+		void ReflectUniforms();
+		//The uniform's entry in m_uniforms, or nullptr if the shader doesn't use it
+		const UniformInfo* FindUniform(Uniform uniform) const;
+		//Connect a uniform block to a binding point, if the shader has it
+		void BindUniformBlock(const char* blockName, GLuint bindingPoint);
 		
 		bool initialised;
 		
 		GLuint m_shaderProg;
 		std::vector<GLuint> m_shaderObjList;
+		UniformInfo m_uniforms[UNIFORM_COUNT];
 		
 		std::string vertexShader;
 		std::string fragmentShader;
@@ -48,6 +136,18 @@ class Shader {
 		std::string key;
 		
 		bool erroredOut = false;
+		bool compiling = false;    //Started, but FinishCompile() hasn't been called yet
+		bool loadedBinary = false; //Came from the binary cache, so there's nothing to check but Configure()
+		std::string cacheFile;
+		
+		bool isInstanced = false;
+		Shader* instancedShader = nullptr;
+		
+		ShaderFeatures features;
+		std::unordered_map<uint32_t, Shader*> variants; //Keyed by ShaderFeatures::bits()
+		
+		unsigned sortID;
+		static unsigned sortIDCounter;
 		
 		static std::unordered_map<std::string, Shader*> loadedShaders;
 };
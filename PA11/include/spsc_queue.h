@@ -0,0 +1,48 @@
+#ifndef SPSC_QUEUE_H
+#define SPSC_QUEUE_H
+
+#include <atomic>
+#include <cstddef>
+
+//Fixed-size queue for passing items from one thread to one other thread without locking
+//Only one thread may push and only one thread may pop - each end's index is only written by its own thread
+//Capacity must be a power of two, and one slot is always left empty to tell full from empty
+template<typename T, size_t Capacity>
+class SPSCQueue {
+	static_assert((Capacity & (Capacity - 1)) == 0, "SPSCQueue capacity must be a power of two");
+
+	public:
+		SPSCQueue() : m_head(0), m_tail(0) {}
+
+		//Producer only - false if the queue is full
+		bool push(const T& item) {
+			size_t tail = m_tail.load(std::memory_order_relaxed);
+			size_t next = (tail + 1) & (Capacity - 1);
+			if (next == m_head.load(std::memory_order_acquire)) return false;
+
+			m_items[tail] = item;
+			//Publishes the item along with the index
+			m_tail.store(next, std::memory_order_release);
+			return true;
+		}
+
+		//Consumer only - false if the queue is empty
+		bool pop(T& item) {
+			size_t head = m_head.load(std::memory_order_relaxed);
+			if (head == m_tail.load(std::memory_order_acquire)) return false;
+
+			item = m_items[head];
+			//Hands the slot back to the producer
+			m_head.store((head + 1) & (Capacity - 1), std::memory_order_release);
+			return true;
+		}
+
+	private:
+		T m_items[Capacity];
+
+		//Kept on separate cache lines so the two threads don't fight over one
+		alignas(64) std::atomic<size_t> m_head; //Next item to pop
+		alignas(64) std::atomic<size_t> m_tail; //Next slot to push into
+};
+
+#endif /* SPSC_QUEUE_H */
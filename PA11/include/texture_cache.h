@@ -0,0 +1,67 @@
+#ifndef TEXTURE_CACHE_H
+#define TEXTURE_CACHE_H
+
+#include <string>
+#include <vector>
+#include <cstdint>
+
+#include "mapped_file.h"
+
+//Cache files sit next to their texture, with this added to the name
+#define TEXTURE_CACHE_EXTENSION ".texcache"
+#define TEXTURE_CACHE_MAGIC     0x58455442 //"BTEX"
+//Bump this whenever the file layout or how mip levels are made or compressed changes
+#define TEXTURE_CACHE_VERSION   2
+//Where the pixels start in the file, and how each level is aligned after that
+#define TEXTURE_CACHE_ALIGNMENT 16
+
+//Decoded textures, with every mip level, saved in a binary file so later runs can skip ImageMagick
+//Layout: TextureCache::Header, then a TextureCache::Level for each mip level, then the pixels of every level
+class TextureCache {
+	public:
+		//Where one mip level's pixels are, relative to Image::data
+		struct Level {
+			uint32_t width;
+			uint32_t height;
+			uint64_t offset;
+			uint64_t size;
+		};
+		
+		//A whole mip chain, largest level first
+		struct Image {
+			uint32_t format = 0;  //OpenGL internal format of the pixels
+			std::vector<Level> levels;
+			const unsigned char* data = nullptr;
+		};
+		
+		//Point image at the cached mip chain of a texture file, which is mapped into mapping
+		//The image is only valid for as long as mapping is kept open
+		//Returns false if there's no cache, or it's out of date - the texture should be decoded normally then
+		static bool read(const std::string& textureFile, MappedFile& mapping, Image& image);
+		//Save a mip chain for next time. Failing to write isn't an error - the cache is just skipped
+		static bool write(const std::string& textureFile, const Image& image);
+		
+		//Box filter RGBA8 pixels down to 1x1, storing every level (including the original) in pixels
+		//image.data is left pointing at pixels
+		static void buildMipChain(const unsigned char* rgba, unsigned width, unsigned height, std::vector<unsigned char>& pixels, Image& image);
+		
+		//Round an offset up to where the next level should start
+		static uint64_t align(uint64_t offset);
+		
+	private:
+		struct Header {
+			uint32_t magic;
+			uint32_t version;
+			uint32_t format;
+			uint32_t levelCount;
+			int64_t sourceTime;   //Modification time of the texture file
+			uint64_t sourceSize;
+			uint64_t sourceHash;  //Checked when the time doesn't match, so touching a file doesn't invalidate it
+			uint64_t dataOffset;  //Where the pixels start
+		};
+		
+		//Get the details of a texture file to compare against a cache
+		static bool describeSource(const std::string& textureFile, Header& header);
+};
+
+#endif /* TEXTURE_CACHE_H */
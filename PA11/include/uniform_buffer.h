@@ -0,0 +1,101 @@
+#ifndef UNIFORM_BUFFER_H
+#define UNIFORM_BUFFER_H
+
+#include <vector>
+#include <cstring>
+
+#include "graphics_headers.h"
+
+//Binding points of the uniform blocks shared by the shaders
+#define UBO_FRAME_BINDING    0
+#define UBO_OBJECT_BINDING   1
+#define UBO_MATERIAL_BINDING 2
+
+//How many frames of data a streamed uniform buffer keeps, so we never write over data still being drawn with
+#define UBO_RING_FRAMES 3
+
+//Byte offsets of the std140 uniform blocks - keep these in sync with the GLSL declarations
+//FrameData: camera and lights. Written once per frame
+struct FrameDataLayout {
+	FrameDataLayout(unsigned numSpotLights);
+
+	size_t viewMatrix;
+	size_t projectionMatrix;
+	size_t ambientLight;
+	size_t spotlightMatrices;
+	size_t spotLightPositions;
+	size_t spotLightDirections;
+	size_t spotLightColors;
+	size_t spotLightStrengths;
+	size_t spotLightAngles;
+
+	size_t size;
+};
+
+//ObjectData: model matrices and highlighting. Written for every object once per frame
+struct ObjectDataLayout {
+	ObjectDataLayout(unsigned numSpotLights);
+
+	size_t modelMatrix;
+	size_t modelViewMatrix;
+	size_t biasMVP;
+	size_t highlight;
+
+	size_t size;
+};
+
+//MaterialData: material colours. Written once per mesh
+struct MaterialDataLayout {
+	MaterialDataLayout();
+
+	size_t ambient;
+	size_t diffuse;
+	size_t specular;
+	size_t shininess;
+
+	size_t size;
+};
+
+//A buffer of uniform blocks, all with the same layout
+//Blocks are filled in a staging copy, sent to OpenGL all at once with upload(), then bound one at a time for draws
+class UniformBuffer {
+	public:
+		//frames is how many uploads are kept in flight - use UBO_RING_FRAMES for data which changes every frame
+		UniformBuffer(GLuint bindingPoint, size_t blockSize, unsigned capacity = 1, unsigned frames = 1);
+		~UniformBuffer();
+
+		//Initalise OpenGL
+		//Call after starting OpenGL, but before using anything else
+		void initGL();
+
+		//Copy data into a block
+		void write(unsigned block, size_t offset, const void* data, size_t size);
+
+		//Send the first count blocks to OpenGL
+		void upload(unsigned count);
+		//Use a block for the following draws
+		void bind(unsigned block);
+		//Call once everything drawn with the last upload has been submitted
+		void fence();
+
+	private:
+		//Make room for at least count blocks
+		void reserve(unsigned count);
+
+		GLuint m_bindingPoint;
+		size_t m_blockSize;
+		size_t m_stride;     //Block size rounded up to GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT
+		unsigned m_capacity; //Blocks per frame
+
+		GLuint m_buffer;
+		unsigned m_frames;
+		unsigned m_frame;    //Which part of the ring the last upload went to
+		std::vector<GLsync> m_fences;
+
+		std::vector<unsigned char> m_staging;
+
+		//Keeps track of whether of not initGL() has been called yet
+		bool initialised;
+};
+
+#endif /* UNIFORM_BUFFER_H */
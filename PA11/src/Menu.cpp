@@ -1,4 +1,5 @@
 #include "Menu.h"
+#include "gl_state.h"
 
 Menu::Menu(Window& a) : window(a), options(_options) {
 	_options.paused = false;
@@ -129,6 +130,22 @@ void Menu::update(int dt, float width, float height) {
 				ImGui::RadioButton("High", &_options.shadowSize, MENU_SHADOWS_HIGH);
 				
 				if(tempShadowSize != _options.shadowSize) _options.changedShadowSize = true;
+				
+				ImGui::Unindent(MENU_OPTIONS_INDENT);
+				ImGui::Text("Last Frame");
+				ImGui::Indent(MENU_OPTIONS_INDENT);
+				ImGui::Text("Objects drawn: %u, culled: %u", stats.drawn, stats.culled);
+				ImGui::Text("Shadow casters drawn: %u, culled: %u", stats.shadowDrawn, stats.shadowCulled);
+				ImGui::Text("Draw calls: %u, uniform uploads: %u", stats.drawCalls, stats.uniformUploads);
+				ImGui::Text("State changes: %u, redundant skipped: %u", stats.stateChanges, stats.redundantStates);
+#ifdef COUNT_ALLOCATIONS
+				ImGui::Text("Heap allocations while rendering: %lu", stats.heapAllocations);
+#endif
+				ImGui::Text("Frame arena: %lu / %lu bytes", (unsigned long) stats.arenaUsed, (unsigned long) stats.arenaCapacity);
+				ImGui::Unindent(MENU_OPTIONS_INDENT);
+				
+				ImGui::Checkbox("GPU Picking", &_options.glPicking);
+				if(ImGui::IsItemHovered()) ImGui::SetTooltip("Debug: pick objects by reading back a render of them instead of ray casting");
 			}
 			
 			ImGui::End();
@@ -151,6 +168,8 @@ void Menu::update(int dt, float width, float height) {
 
 void Menu::render() {
 	ImGui::Render();
+	//ImGui sets and restores OpenGL state itself, not always to what it was
+	GLState::invalidate();
 }
 
 void Menu::setZoom(float zoom) {
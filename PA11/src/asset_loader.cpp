@@ -0,0 +1,25 @@
+#include "asset_loader.h"
+
+AssetLoader::AssetLoader(JobPool& pool) : m_pool(pool) {}
+
+void AssetLoader::requestModel(const std::string& filename) {
+	if(m_models.find(filename) == m_models.end()) {
+		m_models[filename] = m_pool.submit<Model*>(std::bind(&Model::load, filename)).share();
+	}
+}
+
+void AssetLoader::requestTexture(const std::string& filename, bool normalMap) {
+	if(m_textures.find(filename) == m_textures.end()) {
+		m_textures[filename] = m_pool.submit<Texture*>(std::bind(&Texture::load, filename, normalMap)).share();
+	}
+}
+
+Model* AssetLoader::getModel(const std::string& filename) {
+	requestModel(filename);
+	return m_models[filename].get();
+}
+
+Texture* AssetLoader::getTexture(const std::string& filename, bool normalMap) {
+	requestTexture(filename, normalMap);
+	return m_textures[filename].get();
+}
@@ -0,0 +1,364 @@
+#include "block_compress.h"
+#include "graphics_headers.h"
+
+#include <cstring>
+#include <cstdlib>
+#include <algorithm>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+uint32_t BlockCompress::chooseFormat(const unsigned char* rgba, unsigned width, unsigned height, bool normalMap) {
+	if(normalMap) {
+		return BLOCK_FORMAT_BC5;
+	}
+	
+	for(size_t i = 3; i < size_t(width) * height * 4; i += 4) {
+		if(rgba[i] != 255) {
+			return BLOCK_FORMAT_BC3;
+		}
+	}
+	
+	return BLOCK_FORMAT_BC1;
+}
+
+bool BlockCompress::isCompressed(uint32_t format) {
+	return format == BLOCK_FORMAT_BC1 || format == BLOCK_FORMAT_BC3 || format == BLOCK_FORMAT_BC5;
+}
+
+bool BlockCompress::isSupported(uint32_t format) {
+	switch(format) {
+		case BLOCK_FORMAT_BC1:
+		case BLOCK_FORMAT_BC3:
+			return GLEW_EXT_texture_compression_s3tc;
+		case BLOCK_FORMAT_BC5:
+			//RGTC is core since OpenGL 3.0
+			return true;
+		default:
+			return !isCompressed(format);
+	}
+}
+
+unsigned BlockCompress::blockSize(uint32_t format) {
+	return format == BLOCK_FORMAT_BC1 ? 8 : 16;
+}
+
+uint64_t BlockCompress::levelSize(uint32_t format, unsigned width, unsigned height) {
+	if(!isCompressed(format)) {
+		return uint64_t(width) * height * 4;
+	}
+	
+	return uint64_t((width + 3) / 4) * ((height + 3) / 4) * blockSize(format);
+}
+
+void BlockCompress::compress(uint32_t format, TextureCache::Image& image, std::vector<unsigned char>& pixels) {
+	TextureCache::Image compressed;
+	compressed.format = format;
+	compressed.levels = image.levels;
+	
+	uint64_t offset = 0;
+	for(auto& i : compressed.levels) {
+		i.offset = offset;
+		i.size = levelSize(format, i.width, i.height);
+		offset = TextureCache::align(offset + i.size);
+	}
+	
+	std::vector<unsigned char> blocks(offset, 0);
+	for(unsigned i = 0; i < compressed.levels.size(); i++) {
+		const TextureCache::Level& level = compressed.levels[i];
+		compressLevel(format, image.data + image.levels[i].offset, level.width, level.height, &blocks[level.offset]);
+	}
+	
+	pixels.swap(blocks);
+	compressed.data = &pixels[0];
+	image = compressed;
+}
+
+void BlockCompress::decompress(TextureCache::Image& image, std::vector<unsigned char>& pixels) {
+	TextureCache::Image decompressed;
+	decompressed.format = GL_RGBA8;
+	decompressed.levels = image.levels;
+	
+	uint64_t offset = 0;
+	for(auto& i : decompressed.levels) {
+		i.offset = offset;
+		i.size = levelSize(GL_RGBA8, i.width, i.height);
+		offset = TextureCache::align(offset + i.size);
+	}
+	
+	std::vector<unsigned char> rgba(offset, 0);
+	for(unsigned i = 0; i < decompressed.levels.size(); i++) {
+		const TextureCache::Level& level = decompressed.levels[i];
+		decompressLevel(image.format, image.data + image.levels[i].offset, level.width, level.height, &rgba[level.offset]);
+	}
+	
+	pixels.swap(rgba);
+	decompressed.data = &pixels[0];
+	image = decompressed;
+}
+
+void BlockCompress::compressLevel(uint32_t format, const unsigned char* rgba, unsigned width, unsigned height, unsigned char* blocks) {
+	unsigned char block[64];
+	
+	for(unsigned y = 0; y < height; y += 4) {
+		for(unsigned x = 0; x < width; x += 4) {
+			fetchBlock(rgba, width, height, x, y, block);
+			
+			switch(format) {
+				case BLOCK_FORMAT_BC1:
+					encodeColorBlock(block, blocks);
+					break;
+				case BLOCK_FORMAT_BC3:
+					encodeAlphaBlock(block, 3, blocks);
+					encodeColorBlock(block, blocks + 8);
+					break;
+				case BLOCK_FORMAT_BC5:
+					encodeAlphaBlock(block, 0, blocks);
+					encodeAlphaBlock(block, 1, blocks + 8);
+					break;
+			}
+			
+			blocks += blockSize(format);
+		}
+	}
+}
+
+void BlockCompress::decompressLevel(uint32_t format, const unsigned char* blocks, unsigned width, unsigned height, unsigned char* rgba) {
+	unsigned char block[64];
+	
+	for(unsigned y = 0; y < height; y += 4) {
+		for(unsigned x = 0; x < width; x += 4) {
+			switch(format) {
+				case BLOCK_FORMAT_BC1:
+					decodeColorBlock(blocks, false, block);
+					break;
+				case BLOCK_FORMAT_BC3:
+					decodeColorBlock(blocks + 8, true, block);
+					decodeAlphaBlock(blocks, 3, block);
+					break;
+				case BLOCK_FORMAT_BC5:
+					//Same as sampling RGTC2 - blue is 0, alpha is 1
+					memset(block, 0, sizeof(block));
+					decodeAlphaBlock(blocks, 0, block);
+					decodeAlphaBlock(blocks + 8, 1, block);
+					for(unsigned i = 0; i < 16; i++) {
+						block[i * 4 + 3] = 255;
+					}
+					break;
+			}
+			blocks += blockSize(format);
+			
+			//Only copy the part of the block that's actually in the level
+			for(unsigned by = 0; by < 4 && y + by < height; by++) {
+				unsigned count = std::min(4u, width - x);
+				memcpy(&rgba[((y + by) * size_t(width) + x) * 4], &block[by * 16], count * 4);
+			}
+		}
+	}
+}
+
+void BlockCompress::fetchBlock(const unsigned char* rgba, unsigned width, unsigned height, unsigned x, unsigned y, unsigned char* block) {
+	for(unsigned by = 0; by < 4; by++) {
+		unsigned row = std::min(y + by, height - 1);
+		for(unsigned bx = 0; bx < 4; bx++) {
+			unsigned column = std::min(x + bx, width - 1);
+			memcpy(&block[(by * 4 + bx) * 4], &rgba[(row * size_t(width) + column) * 4], 4);
+		}
+	}
+}
+
+void BlockCompress::boundingBox(const unsigned char* block, unsigned char* minColor, unsigned char* maxColor) {
+#ifdef __SSE2__
+	//Each register holds 4 pixels, so 4 registers cover the block
+	__m128i row0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block));
+	__m128i row1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 16));
+	__m128i row2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 32));
+	__m128i row3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(block + 48));
+	
+	__m128i low = _mm_min_epu8(_mm_min_epu8(row0, row1), _mm_min_epu8(row2, row3));
+	__m128i high = _mm_max_epu8(_mm_max_epu8(row0, row1), _mm_max_epu8(row2, row3));
+	
+	//Then fold the 4 pixels left in each register into 1
+	low = _mm_min_epu8(low, _mm_srli_si128(low, 8));
+	low = _mm_min_epu8(low, _mm_srli_si128(low, 4));
+	high = _mm_max_epu8(high, _mm_srli_si128(high, 8));
+	high = _mm_max_epu8(high, _mm_srli_si128(high, 4));
+	
+	int packedLow = _mm_cvtsi128_si32(low);
+	int packedHigh = _mm_cvtsi128_si32(high);
+	memcpy(minColor, &packedLow, 4);
+	memcpy(maxColor, &packedHigh, 4);
+#else
+	memcpy(minColor, block, 4);
+	memcpy(maxColor, block, 4);
+	for(unsigned i = 1; i < 16; i++) {
+		for(unsigned c = 0; c < 4; c++) {
+			minColor[c] = std::min(minColor[c], block[i * 4 + c]);
+			maxColor[c] = std::max(maxColor[c], block[i * 4 + c]);
+		}
+	}
+#endif
+}
+
+uint16_t BlockCompress::packColor(const unsigned char* color) {
+	return ((color[0] >> 3) << 11) | ((color[1] >> 2) << 5) | (color[2] >> 3);
+}
+
+void BlockCompress::unpackColor(uint16_t packed, unsigned char* color) {
+	unsigned r = (packed >> 11) & 0x1F;
+	unsigned g = (packed >> 5) & 0x3F;
+	unsigned b = packed & 0x1F;
+	
+	color[0] = (r << 3) | (r >> 2);
+	color[1] = (g << 2) | (g >> 4);
+	color[2] = (b << 3) | (b >> 2);
+	color[3] = 255;
+}
+
+void BlockCompress::encodeColorBlock(const unsigned char* block, unsigned char* out) {
+	unsigned char minColor[4], maxColor[4];
+	boundingBox(block, minColor, maxColor);
+	
+	//Pull the endpoints in a little, so the interpolated colours land closer to the pixels
+	for(unsigned c = 0; c < 3; c++) {
+		unsigned inset = (maxColor[c] - minColor[c]) >> 4;
+		minColor[c] += inset;
+		maxColor[c] -= inset;
+	}
+	
+	uint16_t color0 = packColor(maxColor);
+	uint16_t color1 = packColor(minColor);
+	//color0 > color1 picks the 4 colour mode
+	if(color0 < color1) {
+		std::swap(color0, color1);
+	}
+	
+	uint32_t indices = 0;
+	if(color0 != color1) {
+		unsigned char palette[4][4];
+		unpackColor(color0, palette[0]);
+		unpackColor(color1, palette[1]);
+		for(unsigned c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+		
+		for(unsigned i = 0; i < 16; i++) {
+			const unsigned char* pixel = &block[i * 4];
+			unsigned best = 0;
+			int bestDistance = 0x7FFFFFFF;
+			for(unsigned p = 0; p < 4; p++) {
+				int dr = pixel[0] - palette[p][0];
+				int dg = pixel[1] - palette[p][1];
+				int db = pixel[2] - palette[p][2];
+				int distance = dr * dr + dg * dg + db * db;
+				if(distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= best << (i * 2);
+		}
+	}
+	
+	out[0] = color0 & 0xFF;
+	out[1] = color0 >> 8;
+	out[2] = color1 & 0xFF;
+	out[3] = color1 >> 8;
+	for(unsigned i = 0; i < 4; i++) {
+		out[4 + i] = (indices >> (i * 8)) & 0xFF;
+	}
+}
+
+void BlockCompress::decodeColorBlock(const unsigned char* in, bool fourColor, unsigned char* block) {
+	uint16_t color0 = in[0] | (in[1] << 8);
+	uint16_t color1 = in[2] | (in[3] << 8);
+	
+	unsigned char palette[4][4];
+	unpackColor(color0, palette[0]);
+	unpackColor(color1, palette[1]);
+	if(fourColor || color0 > color1) {
+		for(unsigned c = 0; c < 3; c++) {
+			palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+			palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+		}
+	} else {
+		for(unsigned c = 0; c < 3; c++) {
+			palette[2][c] = (palette[0][c] + palette[1][c]) / 2;
+			palette[3][c] = 0;
+		}
+	}
+	palette[2][3] = 255;
+	palette[3][3] = 255;
+	
+	uint32_t indices = in[4] | (in[5] << 8) | (in[6] << 16) | (uint32_t(in[7]) << 24);
+	for(unsigned i = 0; i < 16; i++) {
+		memcpy(&block[i * 4], palette[(indices >> (i * 2)) & 3], 4);
+	}
+}
+
+void BlockCompress::encodeAlphaBlock(const unsigned char* block, unsigned channel, unsigned char* out) {
+	unsigned char low = 255, high = 0;
+	for(unsigned i = 0; i < 16; i++) {
+		low = std::min(low, block[i * 4 + channel]);
+		high = std::max(high, block[i * 4 + channel]);
+	}
+	
+	//alpha0 > alpha1 picks the 8 value mode
+	out[0] = high;
+	out[1] = low;
+	
+	uint64_t indices = 0;
+	if(high != low) {
+		unsigned char palette[8];
+		palette[0] = high;
+		palette[1] = low;
+		for(unsigned p = 1; p < 7; p++) {
+			palette[p + 1] = ((7 - p) * high + p * low) / 7;
+		}
+		
+		for(unsigned i = 0; i < 16; i++) {
+			int value = block[i * 4 + channel];
+			unsigned best = 0;
+			int bestDistance = 256;
+			for(unsigned p = 0; p < 8; p++) {
+				int distance = std::abs(value - palette[p]);
+				if(distance < bestDistance) {
+					bestDistance = distance;
+					best = p;
+				}
+			}
+			indices |= uint64_t(best) << (i * 3);
+		}
+	}
+	
+	for(unsigned i = 0; i < 6; i++) {
+		out[2 + i] = (indices >> (i * 8)) & 0xFF;
+	}
+}
+
+void BlockCompress::decodeAlphaBlock(const unsigned char* in, unsigned channel, unsigned char* block) {
+	unsigned char palette[8];
+	palette[0] = in[0];
+	palette[1] = in[1];
+	if(in[0] > in[1]) {
+		for(unsigned p = 1; p < 7; p++) {
+			palette[p + 1] = ((7 - p) * in[0] + p * in[1]) / 7;
+		}
+	} else {
+		for(unsigned p = 1; p < 5; p++) {
+			palette[p + 1] = ((5 - p) * in[0] + p * in[1]) / 5;
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+	
+	uint64_t indices = 0;
+	for(unsigned i = 0; i < 6; i++) {
+		indices |= uint64_t(in[2 + i]) << (i * 8);
+	}
+	for(unsigned i = 0; i < 16; i++) {
+		block[i * 4 + channel] = palette[(indices >> (i * 3)) & 7];
+	}
+}
@@ -0,0 +1,110 @@
+#include "bvh_cache.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+
+//FNV-1a, continuing from hash so several arrays can go into one
+static uint64_t hashBytes(uint64_t hash, const unsigned char* data, size_t size) {
+	for(size_t i = 0; i < size; i++) {
+		hash = (hash ^ data[i]) * 1099511628211ull;
+	}
+	
+	return hash;
+}
+
+void BvhCache::describeTriangles(const btVector3& scale, btStridingMeshInterface* triangles, Header& header) {
+	header.magic = BVH_CACHE_MAGIC;
+	header.version = BVH_CACHE_VERSION;
+	header.scalarSize = sizeof(btScalar);
+	header.triangleCount = 0;
+	header.triangleHash = 14695981039346656037ull;
+	header.scale[0] = scale.x();
+	header.scale[1] = scale.y();
+	header.scale[2] = scale.z();
+	header.bvhSize = 0;
+	
+	for(int i = 0; i < triangles->getNumSubParts(); i++) {
+		const unsigned char* vertices;
+		const unsigned char* indices;
+		int vertexCount, vertexStride, indexStride, triangleCount;
+		PHY_ScalarType vertexType, indexType;
+		
+		triangles->getLockedReadOnlyVertexIndexBase(&vertices, vertexCount, vertexType, vertexStride,
+		                                            &indices, indexStride, triangleCount, indexType, i);
+		header.triangleHash = hashBytes(header.triangleHash, vertices, size_t(vertexCount) * vertexStride);
+		header.triangleHash = hashBytes(header.triangleHash, indices, size_t(triangleCount) * indexStride);
+		header.triangleCount += triangleCount;
+		triangles->unLockReadOnlyVertexBase(i);
+	}
+}
+
+btOptimizedBvh* BvhCache::read(const std::string& modelFile, const btVector3& scale, btStridingMeshInterface* triangles, void*& buffer) {
+	MappedFile cache;
+	if(!cache.open(modelFile + BVH_CACHE_EXTENSION) || cache.size() < sizeof(Header)) {
+		return nullptr;
+	}
+	
+	Header header;
+	memcpy(&header, cache.data(), sizeof(Header));
+	
+	//Checked before hashing the triangles, which is the slow part
+	if(header.magic != BVH_CACHE_MAGIC || header.version != BVH_CACHE_VERSION || header.scalarSize != sizeof(btScalar) ||
+	   header.scale[0] != scale.x() || header.scale[1] != scale.y() || header.scale[2] != scale.z() ||
+	   sizeof(Header) + header.bvhSize > cache.size()) {
+		return nullptr;
+	}
+	
+	Header expected;
+	describeTriangles(scale, triangles, expected);
+	if(header.triangleCount != expected.triangleCount || header.triangleHash != expected.triangleHash) {
+		return nullptr;
+	}
+	
+	//Bullet fixes up the BVH's pointers where it is, so it needs its own writable copy rather than the mapping
+	buffer = btAlignedAlloc(header.bvhSize, BVH_CACHE_ALIGNMENT);
+	memcpy(buffer, cache.data() + sizeof(Header), header.bvhSize);
+	
+	btOptimizedBvh* bvh = btOptimizedBvh::deSerializeInPlace(buffer, header.bvhSize, false);
+	if(bvh == nullptr) {
+		btAlignedFree(buffer);
+		buffer = nullptr;
+	}
+	
+	return bvh;
+}
+
+bool BvhCache::write(const std::string& modelFile, const btVector3& scale, btStridingMeshInterface* triangles, btOptimizedBvh* bvh) {
+	Header header;
+	describeTriangles(scale, triangles, header);
+	header.bvhSize = bvh->calculateSerializeBufferSize();
+	
+	//Serialising copies the BVH out, leaving the one in use alone
+	void* buffer = btAlignedAlloc(header.bvhSize, BVH_CACHE_ALIGNMENT);
+	if(!bvh->serializeInPlace(buffer, header.bvhSize, false)) {
+		btAlignedFree(buffer);
+		return false;
+	}
+	
+	//Write somewhere else first, so a half-written cache is never read
+	std::string cacheFile = modelFile + BVH_CACHE_EXTENSION;
+	std::string tempFile = cacheFile + ".tmp";
+	
+	std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+	if(!out.is_open()) {
+		btAlignedFree(buffer);
+		return false;
+	}
+	
+	out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	out.write(reinterpret_cast<const char*>(buffer), header.bvhSize);
+	btAlignedFree(buffer);
+	
+	out.close();
+	if(!out) {
+		std::remove(tempFile.c_str());
+		return false;
+	}
+	
+	return std::rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+}
@@ -0,0 +1,138 @@
+#include "convex_decomposition.h"
+
+#include <LinearMath/btConvexHullComputer.h>
+#include <cmath>
+
+ConvexDecomposition::TriangleCollector::TriangleCollector(std::vector<btVector3>& corners) : m_corners(corners) {}
+
+void ConvexDecomposition::TriangleCollector::internalProcessTriangleIndex(btVector3* triangle, int partId, int triangleIndex) {
+	m_corners.push_back(triangle[0]);
+	m_corners.push_back(triangle[1]);
+	m_corners.push_back(triangle[2]);
+}
+
+btCollisionShape* ConvexDecomposition::createShape(btStridingMeshInterface* triangles) {
+	std::vector<btVector3> corners;
+	TriangleCollector collector(corners);
+	btVector3 everywhere(BT_LARGE_FLOAT, BT_LARGE_FLOAT, BT_LARGE_FLOAT);
+	triangles->InternalProcessAllTriangles(&collector, -everywhere, everywhere);
+	
+	std::vector<std::vector<btVector3>> parts;
+	decompose(corners, 0, parts);
+	
+	if (parts.size() == 1) {
+		return createHull(parts[0]);
+	}
+	
+	//Each part is already where it belongs in the mesh, so none of them need moving
+	btCompoundShape* compound = new btCompoundShape();
+	btTransform identity;
+	identity.setIdentity();
+	for (const auto& i : parts) {
+		compound->addChildShape(identity, createHull(i));
+	}
+	
+	return compound;
+}
+
+void ConvexDecomposition::decompose(const std::vector<btVector3>& corners, unsigned depth, std::vector<std::vector<btVector3>>& parts) {
+	if (depth >= CONVEX_DECOMPOSITION_MAX_DEPTH || corners.size() < 6) {
+		parts.push_back(corners);
+		return;
+	}
+	
+	//Halve the triangles across the longest side, at the middle of their centres
+	btVector3 low = corners[0];
+	btVector3 high = corners[0];
+	btVector3 centre(0, 0, 0);
+	for (const auto& i : corners) {
+		low.setMin(i);
+		high.setMax(i);
+		centre += i;
+	}
+	centre /= btScalar(corners.size());
+	int axis = (high - low).maxAxis();
+	
+	std::vector<btVector3> below;
+	std::vector<btVector3> above;
+	for (size_t i = 0; i < corners.size(); i += 3) {
+		btScalar middle = (corners[i][axis] + corners[i + 1][axis] + corners[i + 2][axis]) / 3;
+		std::vector<btVector3>& side = middle < centre[axis] ? below : above;
+		side.insert(side.end(), corners.begin() + i, corners.begin() + i + 3);
+	}
+	
+	//Not worth splitting if the halves' hulls fill about as much as the whole one - it's convex enough already
+	btScalar whole = hullVolume(corners);
+	btScalar halves = hullVolume(below) + hullVolume(above);
+	if (below.empty() || above.empty() || whole <= SIMD_EPSILON || halves > whole * (1 - CONVEX_DECOMPOSITION_MIN_GAIN)) {
+		parts.push_back(corners);
+		return;
+	}
+	
+	decompose(below, depth + 1, parts);
+	decompose(above, depth + 1, parts);
+}
+
+btScalar ConvexDecomposition::hullVolume(const std::vector<btVector3>& points) {
+	if (points.size() < 4) {
+		return 0;
+	}
+	
+	btConvexHullComputer hull;
+	hull.compute(&points[0].x(), sizeof(btVector3), points.size(), 0, 0);
+	
+	//Fan each face out from its first vertex, and add up the tetrahedra those make with the origin
+	btScalar volume = 0;
+	for (int i = 0; i < hull.faces.size(); i++) {
+		const btConvexHullComputer::Edge* first = &hull.edges[hull.faces[i]];
+		const btVector3& corner = hull.vertices[first->getSourceVertex()];
+		
+		const btConvexHullComputer::Edge* edge = first->getNextEdgeOfFace();
+		while (edge->getTargetVertex() != first->getSourceVertex()) {
+			volume += corner.dot(hull.vertices[edge->getSourceVertex()].cross(hull.vertices[edge->getTargetVertex()]));
+			edge = edge->getNextEdgeOfFace();
+		}
+	}
+	
+	return std::abs(volume) / 6;
+}
+
+btConvexHullShape* ConvexDecomposition::createHull(const std::vector<btVector3>& points) {
+	btConvexHullShape* shape = new btConvexHullShape();
+	if (points.empty()) {
+		return shape;
+	}
+	
+	btConvexHullComputer hull;
+	hull.compute(&points[0].x(), sizeof(btVector3), points.size(), 0, 0);
+	
+	if (hull.vertices.size() <= CONVEX_DECOMPOSITION_MAX_HULL_VERTICES) {
+		for (int i = 0; i < hull.vertices.size(); i++) {
+			shape->addPoint(hull.vertices[i], false);
+		}
+		shape->recalcLocalAabb();
+		return shape;
+	}
+	
+	//Too many to keep, so only keep the furthest vertex in each of a spread of directions
+	//Directions are spaced evenly around a sphere along a spiral, so no side of the hull loses more than another
+	std::vector<bool> kept(hull.vertices.size(), false);
+	const btScalar goldenAngle = SIMD_PI * (3 - std::sqrt(btScalar(5)));
+	for (int i = 0; i < CONVEX_DECOMPOSITION_MAX_HULL_VERTICES; i++) {
+		btScalar y = 1 - 2 * (i + btScalar(0.5)) / CONVEX_DECOMPOSITION_MAX_HULL_VERTICES;
+		btScalar radius = std::sqrt(1 - y * y);
+		btVector3 direction(std::cos(goldenAngle * i) * radius, y, std::sin(goldenAngle * i) * radius);
+		
+		btScalar furthest;
+		kept[direction.maxDot(&hull.vertices[0], hull.vertices.size(), furthest)] = true;
+	}
+	
+	for (int i = 0; i < hull.vertices.size(); i++) {
+		if (kept[i]) {
+			shape->addPoint(hull.vertices[i], false);
+		}
+	}
+	shape->recalcLocalAabb();
+	
+	return shape;
+}
@@ -1,5 +1,6 @@
 
 #include "engine.h"
+#include "gl_state.h"
 
 Engine::Engine(const Context &a) : _ctx(a), ctx(_ctx), windowWidth(_ctx.width), windowHeight(_ctx.height) {}
 
@@ -28,7 +29,7 @@ bool Engine::Initialize() {
 	m_menu = new Menu(*m_window);
 
 	// Start the graphics
-	m_graphics = new Graphics(*m_menu, _ctx.width, _ctx.height, _ctx.gameWorldCtx);
+	m_graphics = new Graphics(*m_menu, _ctx.width, _ctx.height, _ctx.gameWorldCtx, _ctx.physWorld);
 	if(_ctx.lights != nullptr){
 		for(auto& i : *_ctx.lights) {
 			m_graphics->addLight(i);
@@ -43,6 +44,7 @@ bool Engine::Initialize() {
 	}
 
 	Object::menu = m_menu;
+	Object::physics = _ctx.physWorld;
 
 	// Set the time
 	m_currentTimeMillis = GetCurrentTimeMillis();
@@ -55,6 +57,9 @@ void Engine::Run() {
 	m_running = true;
 
 	bool newGame = false;
+	
+	//Every body exists by now, so the world can be handed over to its thread
+	_ctx.physWorld->start();
 
 	while (m_running) {
 		// Update the DT
@@ -113,8 +118,11 @@ void Engine::Run() {
 			m_menu->isNewGame = false;
 		}
 		
+		//Objects are drawn between the last two physics steps, wherever the physics thread has got to
+		_ctx.physWorld->setPaused(m_menu->options.paused);
+		_ctx.physWorld->updateSnapshot();
+		_ctx.physWorld->updateGame();
 		m_graphics->Update(m_DT);
-		if(!m_menu->options.paused) _ctx.physWorld->update(m_DT);
 
 		// Update menu options and labels
 		m_menu->update(m_DT, _ctx.width, _ctx.height);
@@ -130,8 +138,7 @@ void Engine::Run() {
 		}
 		
 		if(!wasTakeShot && ctx.gameWorldCtx->mode == MODE_TAKE_SHOT) {
-			btVector3 trans = ctx.physWorld->getLoadedBodies()->operator[](
-					ctx.gameWorldCtx->cueBall)->getWorldTransform().getOrigin();
+			btVector3 trans = ctx.physWorld->bodyState(ctx.gameWorldCtx->cueBall).origin;
 			m_graphics->getCamView()->moveTowards(glm::vec3(trans.x(), trans.y(), trans.z()), 1000);
 		}
 
@@ -143,6 +150,7 @@ void Engine::Run() {
 		m_window->Swap();
 	}
 
+	_ctx.physWorld->stop();
 	ImGui_ImplSdlGL3_Shutdown();
 }
 
@@ -262,11 +270,12 @@ void Engine::eventHandler(unsigned dt) {
 							
 							btVector3 impVector(glmImpVector.x, glmImpVector.y, glmImpVector.z);
 							btVector3 locVector(pickedPosition.x, pickedPosition.y, pickedPosition.z);
-							picked->ctx.physicsBody->applyImpulse(impVector, locVector);
+							ctx.physWorld->applyImpulse(picked->ctx.rigidBodyIndex, impVector, locVector);
 							
 							ctx.gameWorldCtx->isNextShotOK = false;
 							ctx.gameWorldCtx->turnSwapped = false;
 							_ctx.gameWorldCtx->mode = MODE_WAIT_NEXT;
+							m_graphics->setHighlighted(nullptr);
 						}
 						break;
 					}
@@ -280,6 +289,13 @@ void Engine::eventHandler(unsigned dt) {
 		}
 	}
 	else if (m_event.type == SDL_MOUSEMOTION) {
+		//Light up whatever would be hit if the mouse was clicked now
+		if (ctx.gameWorldCtx->mode == MODE_TAKE_SHOT && !ImGui::GetIO().WantCaptureMouse) {
+			m_graphics->setHighlighted(m_graphics->getObjectOnScreen(m_event.motion.x, _ctx.height - m_event.motion.y));
+		} else {
+			m_graphics->setHighlighted(nullptr);
+		}
+		
 		switch(ctx.gameWorldCtx->mode) {
 			case MODE_PLACE_CUE:
 				float yPos = 0.1; //Radius - maybe load this from config?
@@ -316,14 +332,7 @@ void Engine::eventHandler(unsigned dt) {
 					zPos = (zPos > kMod * zMin) ? kMod * zMin : ((zPos < kMod * zMax) ? kMod * zMax : zPos);
 				}
 				
-				btTransform ballTransform;
-				ballTransform.setIdentity();
-				ballTransform.setOrigin(btVector3(xPos, yPos, zPos));
-				
-				btRigidBody* ball = ctx.physWorld->getLoadedBodies()->operator[](ctx.gameWorldCtx->cueBall);
-				ball->setWorldTransform(ballTransform);
-				ball->setLinearVelocity(btVector3(0.0, 0.0, 0.0));
-				ball->setAngularVelocity(btVector3(0.0, 0.0, 0.0));
+				ctx.physWorld->placeBody(ctx.gameWorldCtx->cueBall, btVector3(xPos, yPos, zPos));
 				
 				break;
 		}
@@ -364,7 +373,7 @@ void Engine::eventHandler(unsigned dt) {
 
 				//Tell OpenGL how large our window is now
 				//SUPER IMPORTANT
-				glViewport(0, 0, windowWidth, windowHeight);
+				GLState::viewport(0, 0, windowWidth, windowHeight);
 				break;
 		}
 	}
@@ -410,8 +419,6 @@ void Engine::NewGame() {
 	static float zOrigin = 1.07326 * 2.5; //Vertex from obj file times scale divided by 2
 	
 	float xCoord;
-	btTransform ballTransform;
-	btRigidBody* body;
 	
 	std::vector<int> tempBallIndices = _ctx.physWorld->ballIndices;
 	std::vector<int> randBallIndices;
@@ -446,14 +453,7 @@ void Engine::NewGame() {
 		for(int j = 0; j <= i; j++) {
 			xCoord = i == 0 ? 0 : - width / 2 + width / i * j;
 			
-			ballTransform.setIdentity();
-			ballTransform.setOrigin(btVector3(xCoord, yOrigin, i * height + zOrigin));
-			
-			body = (*(_ctx.physWorld->getLoadedBodies()))[randBallIndices[i * (i + 1) / 2 + j]];
-
-			body->setWorldTransform(ballTransform);
-			body->setLinearVelocity(btVector3(0, 0, 0));
-			body->setAngularVelocity(btVector3(0, 0, 0));
+			_ctx.physWorld->placeBody(randBallIndices[i * (i + 1) / 2 + j], btVector3(xCoord, yOrigin, i * height + zOrigin));
 		}
 	}
 	
@@ -466,6 +466,5 @@ void Engine::NewGame() {
 	_ctx.gameWorldCtx->isNextShotOK = true;
 
 	//For testing purposes - uncomment to see ball placement without physics, then press P to turn physics on
-	//_ctx.physWorld->update(20);
 	//m_menu->pause();
 }
\ No newline at end of file
@@ -0,0 +1,82 @@
+#include "frame_arena.h"
+
+#include <new>
+#include <cstdlib>
+
+#ifdef COUNT_ALLOCATIONS
+//Each thread counts its own, so the physics and loader threads don't show up in the render thread's count
+//Plain data, so it needs no constructing before the first new on a thread
+static thread_local unsigned long allocationCount = 0;
+
+//Every other form of new and delete ends up in these
+void* operator new(size_t size) {
+	allocationCount++;
+	
+	void* memory = malloc(size > 0 ? size : 1);
+	if(memory == nullptr) throw std::bad_alloc();
+	return memory;
+}
+
+void operator delete(void* memory) noexcept {
+	free(memory);
+}
+#endif
+
+FrameArena::FrameArena(size_t capacity) : m_capacity(capacity), m_used(0), m_overflowSize(0) {
+	m_block = static_cast<unsigned char*>(malloc(m_capacity));
+}
+
+FrameArena::~FrameArena() {
+	for(auto& i : m_overflow) {
+		free(i);
+	}
+	free(m_block);
+}
+
+void FrameArena::reset() {
+	if(!m_overflow.empty()) {
+		for(auto& i : m_overflow) {
+			free(i);
+		}
+		m_overflow.clear();
+		
+		//Room for everything last frame needed, with some to spare
+		m_capacity = (m_used + m_overflowSize) * 2;
+		free(m_block);
+		m_block = static_cast<unsigned char*>(malloc(m_capacity));
+	}
+	
+	m_used = 0;
+	m_overflowSize = 0;
+}
+
+void* FrameArena::allocate(size_t size, size_t alignment) {
+	size_t start = (m_used + alignment - 1) / alignment * alignment;
+	
+	if(start + size > m_capacity) {
+		//Out of room - fall back to the heap until reset() makes the block bigger
+		void* memory = malloc(size > 0 ? size : 1);
+		m_overflow.push_back(memory);
+		m_overflowSize += size + alignment;
+		return memory;
+	}
+	
+	m_used = start + size;
+	return m_block + start;
+}
+
+size_t FrameArena::used() const {
+	return m_used + m_overflowSize;
+}
+
+size_t FrameArena::capacity() const {
+	return m_capacity;
+}
+
+unsigned long FrameArena::heapAllocations() {
+#ifdef COUNT_ALLOCATIONS
+	return allocationCount;
+#else
+	return 0;
+#endif
+}
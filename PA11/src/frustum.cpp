@@ -0,0 +1,34 @@
+#include "frustum.h"
+
+Frustum::Frustum() {}
+
+Frustum::Frustum(const glm::mat4& viewProjection) {
+	//Each plane is the last row of the matrix plus or minus one of the others
+	//glm is column major, so row i is viewProjection[0][i] ... viewProjection[3][i]
+	glm::vec4 rows[4];
+	for(int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(viewProjection[0][i], viewProjection[1][i], viewProjection[2][i], viewProjection[3][i]);
+	}
+	
+	planes[0] = rows[3] + rows[0]; //Left
+	planes[1] = rows[3] - rows[0]; //Right
+	planes[2] = rows[3] + rows[1]; //Bottom
+	planes[3] = rows[3] - rows[1]; //Top
+	planes[4] = rows[3] + rows[2]; //Near
+	planes[5] = rows[3] - rows[2]; //Far
+	
+	//Normalise so distances come out in world units
+	for(auto& i : planes) {
+		i /= glm::length(glm::vec3(i));
+	}
+}
+
+bool Frustum::intersectsSphere(const glm::vec3& center, float radius) const {
+	for(const auto& i : planes) {
+		if(glm::dot(glm::vec3(i), center) + i.w < -radius) {
+			return false;
+		}
+	}
+	
+	return true;
+}
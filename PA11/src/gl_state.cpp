@@ -0,0 +1,310 @@
+#include "gl_state.h"
+
+#include <iostream>
+
+GLuint GLState::m_program = GLState::UNKNOWN;
+GLuint GLState::m_vao = GLState::UNKNOWN;
+GLuint GLState::m_arrayBuffer = GLState::UNKNOWN;
+GLuint GLState::m_elementBuffer = GLState::UNKNOWN;
+GLuint GLState::m_uniformBuffer = GLState::UNKNOWN;
+GLState::UniformRange GLState::m_uniformRanges[GL_STATE_UNIFORM_BINDINGS];
+GLenum GLState::m_activeUnit = GLState::UNKNOWN;
+GLuint GLState::m_textures[GL_STATE_TEXTURE_UNITS][2];
+GLuint GLState::m_drawFramebuffer = GLState::UNKNOWN;
+GLuint GLState::m_readFramebuffer = GLState::UNKNOWN;
+GLint GLState::m_viewport[4];
+GLuint GLState::m_enabled[3];
+GLenum GLState::m_depthFunc = GLState::UNKNOWN;
+GLenum GLState::m_cullFace = GLState::UNKNOWN;
+GLenum GLState::m_blendFunc[2];
+GLState::Counters GLState::m_counters;
+
+//Fills in the arrays, which can't be given UNKNOWN in their definitions
+static struct GLStateInitialiser {
+	GLStateInitialiser() {
+		GLState::invalidate();
+	}
+} glStateInitialiser;
+
+template<typename T>
+bool GLState::change(T& cached, const T& value) {
+	if (cached == value) {
+		m_counters.redundant++;
+		return false;
+	}
+	
+	cached = value;
+	m_counters.stateChanges++;
+	return true;
+}
+
+int GLState::capabilityIndex(GLenum capability) {
+	switch (capability) {
+		case GL_DEPTH_TEST:
+			return 0;
+		case GL_CULL_FACE:
+			return 1;
+		case GL_BLEND:
+			return 2;
+		default:
+			return -1;
+	}
+}
+
+int GLState::textureTargetIndex(GLenum target) {
+	switch (target) {
+		case GL_TEXTURE_2D:
+			return 0;
+		case GL_TEXTURE_2D_ARRAY:
+			return 1;
+		default:
+			return -1;
+	}
+}
+
+void GLState::useProgram(GLuint program) {
+	if (change(m_program, program)) glUseProgram(program);
+}
+
+void GLState::bindVertexArray(GLuint vao) {
+	if (change(m_vao, vao)) {
+		glBindVertexArray(vao);
+		m_elementBuffer = UNKNOWN;
+	}
+}
+
+void GLState::bindBuffer(GLenum target, GLuint buffer) {
+	GLuint* cached = nullptr;
+	switch (target) {
+		case GL_ARRAY_BUFFER:
+			cached = &m_arrayBuffer;
+			break;
+		case GL_ELEMENT_ARRAY_BUFFER:
+			cached = &m_elementBuffer;
+			break;
+		case GL_UNIFORM_BUFFER:
+			cached = &m_uniformBuffer;
+			break;
+	}
+	
+	if (cached == nullptr) {
+		m_counters.stateChanges++;
+		glBindBuffer(target, buffer);
+	} else if (change(*cached, buffer)) {
+		glBindBuffer(target, buffer);
+	}
+}
+
+void GLState::bindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size) {
+	//Binding a range also binds the buffer to the generic target
+	if (target == GL_UNIFORM_BUFFER) m_uniformBuffer = buffer;
+	
+	if (target != GL_UNIFORM_BUFFER || index >= GL_STATE_UNIFORM_BINDINGS) {
+		m_counters.stateChanges++;
+		glBindBufferRange(target, index, buffer, offset, size);
+		return;
+	}
+	
+	UniformRange& cached = m_uniformRanges[index];
+	if (cached.buffer == buffer && cached.offset == offset && cached.size == size) {
+		m_counters.redundant++;
+		return;
+	}
+	
+	cached.buffer = buffer;
+	cached.offset = offset;
+	cached.size = size;
+	m_counters.stateChanges++;
+	glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GLState::bindTexture(GLenum unit, GLenum target, GLuint texture) {
+	unsigned index = unit - GL_TEXTURE0;
+	int targetIndex = textureTargetIndex(target);
+	
+	//Nothing to do if it's already there, even if another unit is active
+	if (index < GL_STATE_TEXTURE_UNITS && targetIndex != -1 && m_textures[index][targetIndex] == texture) {
+		m_counters.redundant++;
+		return;
+	}
+	
+	if (change(m_activeUnit, unit)) glActiveTexture(unit);
+	bindTexture(target, texture);
+}
+
+void GLState::bindTexture(GLenum target, GLuint texture) {
+	unsigned index = m_activeUnit - GL_TEXTURE0;
+	int targetIndex = textureTargetIndex(target);
+	
+	if (index >= GL_STATE_TEXTURE_UNITS || targetIndex == -1) {
+		m_counters.stateChanges++;
+		glBindTexture(target, texture);
+	} else if (change(m_textures[index][targetIndex], texture)) {
+		glBindTexture(target, texture);
+	}
+}
+
+void GLState::bindFramebuffer(GLenum target, GLuint framebuffer) {
+	bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+	bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+	
+	if ((!draw || m_drawFramebuffer == framebuffer) && (!read || m_readFramebuffer == framebuffer)) {
+		m_counters.redundant++;
+		return;
+	}
+	
+	if (draw) m_drawFramebuffer = framebuffer;
+	if (read) m_readFramebuffer = framebuffer;
+	m_counters.stateChanges++;
+	glBindFramebuffer(target, framebuffer);
+}
+
+void GLState::viewport(GLint x, GLint y, GLsizei width, GLsizei height) {
+	if (m_viewport[0] == x && m_viewport[1] == y && m_viewport[2] == width && m_viewport[3] == height) {
+		m_counters.redundant++;
+		return;
+	}
+	
+	m_viewport[0] = x;
+	m_viewport[1] = y;
+	m_viewport[2] = width;
+	m_viewport[3] = height;
+	m_counters.stateChanges++;
+	glViewport(x, y, width, height);
+}
+
+void GLState::enable(GLenum capability) {
+	int index = capabilityIndex(capability);
+	if (index == -1) {
+		m_counters.stateChanges++;
+		glEnable(capability);
+	} else if (change(m_enabled[index], (GLuint) GL_TRUE)) {
+		glEnable(capability);
+	}
+}
+
+void GLState::disable(GLenum capability) {
+	int index = capabilityIndex(capability);
+	if (index == -1) {
+		m_counters.stateChanges++;
+		glDisable(capability);
+	} else if (change(m_enabled[index], (GLuint) GL_FALSE)) {
+		glDisable(capability);
+	}
+}
+
+void GLState::depthFunc(GLenum func) {
+	if (change(m_depthFunc, func)) glDepthFunc(func);
+}
+
+void GLState::cullFace(GLenum mode) {
+	if (change(m_cullFace, mode)) glCullFace(mode);
+}
+
+void GLState::blendFunc(GLenum source, GLenum destination) {
+	if (m_blendFunc[0] == source && m_blendFunc[1] == destination) {
+		m_counters.redundant++;
+		return;
+	}
+	
+	m_blendFunc[0] = source;
+	m_blendFunc[1] = destination;
+	m_counters.stateChanges++;
+	glBlendFunc(source, destination);
+}
+
+void GLState::deleteBuffer(GLuint buffer) {
+	//OpenGL unbinds a deleted buffer from everything it's bound to
+	if (m_arrayBuffer == buffer) m_arrayBuffer = 0;
+	if (m_elementBuffer == buffer) m_elementBuffer = 0;
+	if (m_uniformBuffer == buffer) m_uniformBuffer = 0;
+	for (auto& i : m_uniformRanges) {
+		if (i.buffer == buffer) i.buffer = UNKNOWN;
+	}
+	
+	glDeleteBuffers(1, &buffer);
+}
+
+void GLState::deleteProgram(GLuint program) {
+	//A program in use is only deleted once it stops being used, so the cache stays right until then
+	if (m_program == program) {
+		useProgram(0);
+	}
+	
+	glDeleteProgram(program);
+}
+
+void GLState::drawElements(GLenum mode, GLsizei count, GLenum type, const void* offset) {
+	m_counters.drawCalls++;
+	glDrawElements(mode, count, type, offset);
+}
+
+void GLState::drawElementsInstanced(GLenum mode, GLsizei count, GLenum type, const void* offset, GLsizei instances) {
+	m_counters.drawCalls++;
+	glDrawElementsInstanced(mode, count, type, offset, instances);
+}
+
+void GLState::drawArrays(GLenum mode, GLint first, GLsizei count) {
+	m_counters.drawCalls++;
+	glDrawArrays(mode, first, count);
+}
+
+void GLState::countUniformUpload() {
+	m_counters.uniformUploads++;
+}
+
+void GLState::invalidate() {
+	m_program = UNKNOWN;
+	m_vao = UNKNOWN;
+	m_arrayBuffer = UNKNOWN;
+	m_elementBuffer = UNKNOWN;
+	m_uniformBuffer = UNKNOWN;
+	for (auto& i : m_uniformRanges) {
+		i.buffer = UNKNOWN;
+	}
+	m_activeUnit = UNKNOWN;
+	for (auto& i : m_textures) {
+		i[0] = i[1] = UNKNOWN;
+	}
+	m_drawFramebuffer = UNKNOWN;
+	m_readFramebuffer = UNKNOWN;
+	m_viewport[0] = m_viewport[1] = m_viewport[2] = m_viewport[3] = -1;
+	for (auto& i : m_enabled) {
+		i = UNKNOWN;
+	}
+	m_depthFunc = UNKNOWN;
+	m_cullFace = UNKNOWN;
+	m_blendFunc[0] = m_blendFunc[1] = UNKNOWN;
+}
+
+const GLState::Counters& GLState::counters() {
+	return m_counters;
+}
+
+void GLState::resetCounters() {
+	m_counters = Counters();
+}
+
+#ifdef OPENGL_DEBUG
+static void GLAPIENTRY debugMessage(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length,
+                                  const GLchar* message, const void* userParam) {
+	//Notifications are things like where buffers ended up, not problems
+	if (severity == GL_DEBUG_SEVERITY_NOTIFICATION) return;
+	
+	std::cerr << (type == GL_DEBUG_TYPE_ERROR ? "OpenGL error: " : "OpenGL warning: ") << message << std::endl;
+}
+#endif
+
+void GLState::enableDebugOutput() {
+#ifdef OPENGL_DEBUG
+	if (!GLEW_KHR_debug) {
+		std::cerr << "KHR_debug isn't supported, so OpenGL errors won't be reported" << std::endl;
+		return;
+	}
+	
+	glEnable(GL_DEBUG_OUTPUT);
+	//Report errors from inside the call that caused them, so they show up in a debugger's backtrace
+	glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+	glDebugMessageCallback(debugMessage, nullptr);
+#endif
+}
@@ -1,9 +1,11 @@
 #include "graphics.h"
+#include "gl_state.h"
 
-Graphics::Graphics(Menu& menu, const int& w, const int& h, GameWorld::ctx* gwc) : windowWidth(w),
-                                                                                  windowHeight(h),
-                                                                                  m_menu(menu),
-                                                                                  gameWorldCtx(gwc) {
+Graphics::Graphics(Menu& menu, const int& w, const int& h, GameWorld::ctx* gwc, PhysicsWorld* physWorld) : windowWidth(w),
+                                                                                                         windowHeight(h),
+                                                                                                         m_menu(menu),
+                                                                                                         gameWorldCtx(gwc),
+                                                                                                         physWorld(physWorld) {
 	camView = new Camera(menu);
 	
 	Object::projectionMatrix = &camView->GetProjection();
@@ -11,6 +13,7 @@ Graphics::Graphics(Menu& menu, const int& w, const int& h, GameWorld::ctx* gwc)
 	
 	pickShader = Shader::load("shaders/pick.vert", "shaders/pick.frag");
 	shadowShader = Shader::load("shaders/shadow.vert", "shaders/shadow.frag");
+	fallbackShader = Shader::load("shaders/unlit.vert", "shaders/unlit.frag");
 }
 
 Graphics::~Graphics() {
@@ -18,6 +21,11 @@ Graphics::~Graphics() {
 		delete camView;
 		camView = NULL;
 	}
+	
+	delete frameUniforms;
+	frameUniforms = nullptr;
+	delete objectUniforms;
+	objectUniforms = nullptr;
 }
 
 void Graphics::addLight(LightContext* light) {
@@ -46,26 +54,64 @@ bool Graphics::Initialize(int width, int height) {
 		return false;
 	}
 #endif
+	GLState::enableDebugOutput();
+	
 	// Initialize Camera
 	camView->Initialize(width, height);
 	
-	// For OpenGL 3
-	GLuint vao;
-	glGenVertexArrays(1, &vao);
-	glBindVertexArray(vao);
+	shaderDictionary["NUM_SPOT_LIGHTS"] = std::to_string(spotLights.size());
 	
-	std::unordered_map<std::string, std::string> dictionary;
-	dictionary["NUM_SPOT_LIGHTS"] = std::to_string(spotLights.size());
+	//Needs the textures before they're sent to OpenGL
+	buildInstanceGroups();
 	
 	for (int i = 0; i < gameWorldCtx->worldObjects.size(); i++) {
-		gameWorldCtx->worldObjects[i]->Init_GL(&dictionary);
+		gameWorldCtx->worldObjects[i]->Init_GL();
+		//Start on what the first frame needs - the fallback covers it until it's done
+		//Other variants, and shaders like altShader, aren't compiled until they're first drawn with
+		gameWorldCtx->worldObjects[i]->GetShader(shadowSamples())->InitializeAsync(&shaderDictionary);
+	}
+	
+	//Textures are shared, so layers can only go once anything drawing them on their own has sent them to OpenGL
+	//Whatever's still held now was only needed for copying into the arrays
+	for (auto& group : instanceGroups) {
+		for (auto& i : group.objects) {
+			i->ctx.texture->releaseData();
+		}
 	}
 	
 	pickShader->Initialize();
-	shadowShader->Initialize();
+	shadowShader->Initialize(&shaderDictionary);
+	
+	//Every variant of the fallback has to be ready before the first frame
+	ShaderFeatures fallbackFeatures;
+	for (int textured = 0; textured < 2; textured++) {
+		fallbackFeatures.hasTexture = textured;
+		fallbackShader->variant(fallbackFeatures)->Initialize(&shaderDictionary);
+	}
+	
+	for (auto& group : instanceGroups) {
+		group.textures->initGL();
+		
+		glGenBuffers(1, &group.instanceBuffer);
+		group.vaos = group.model->initInstancedGL(group.instanceBuffer);
+		group.depthVaos = group.model->initInstancedGL(group.instanceBuffer, true);
+		
+		group.objects[0]->GetShader(shadowSamples())->instanced()->InitializeAsync(&shaderDictionary);
+	}
+	if (!instanceGroups.empty()) {
+		pickShader->instanced()->Initialize();
+		shadowShader->instanced()->Initialize(&shaderDictionary);
+		fallbackShader->instanced()->Initialize(&shaderDictionary);
+	}
 	
 	spotlightMatrices.resize(spotLights.size());
 	
+	frameUniforms = new UniformBuffer(UBO_FRAME_BINDING, FrameDataLayout(spotLights.size()).size, 1, UBO_RING_FRAMES);
+	frameUniforms->initGL();
+	objectUniforms = new UniformBuffer(UBO_OBJECT_BINDING, ObjectDataLayout(spotLights.size()).size,
+	                                   gameWorldCtx->worldObjects.size(), UBO_RING_FRAMES);
+	objectUniforms->initGL();
+	
 	char str[256];
 	int p2Score = 1;
 	sprintf( str, "Player 1:  %d", p2Score);
@@ -74,8 +120,8 @@ bool Graphics::Initialize(int width, int height) {
 	glGenFramebuffers(1, &pickBuffer);
 	glGenTextures(1, &pickTexture);
 	
-	glBindFramebuffer(GL_FRAMEBUFFER, pickBuffer);
-	glBindTexture(GL_TEXTURE_2D, pickTexture);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, pickBuffer);
+	GLState::bindTexture(GL_TEXTURE_2D, pickTexture);
 	
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pickTexture, 0);
@@ -85,10 +131,38 @@ bool Graphics::Initialize(int width, int height) {
 	glGenFramebuffers(1, &spotlightShadowBuffer);
 	glGenTextures(1, &spotlightShadowTexture);
 	
-	glBindFramebuffer(GL_FRAMEBUFFER, spotlightShadowBuffer);
-	glBindTexture(GL_TEXTURE_2D_ARRAY, spotlightShadowTexture);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, spotlightShadowBuffer);
+	allocateShadowTexture(spotlightShadowTexture);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, spotlightShadowTexture, 0, 0);
 	
-	//glTextureStorage3D(spotlightShadowTexture, 1, GL_RGB16, m_menu.options.shadowSize, m_menu.options.shadowSize, spotLights.size());
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	
+	glGenFramebuffers(1, &staticShadowBuffer);
+	glGenTextures(1, &staticShadowTexture);
+	
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, staticShadowBuffer);
+	allocateShadowTexture(staticShadowTexture);
+	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticShadowTexture, 0, 0);
+	
+	glDrawBuffer(GL_NONE);
+	glReadBuffer(GL_NONE);
+	
+	staticShadowMatrices.resize(spotLights.size());
+	staticShadowValid.assign(spotLights.size(), false);
+	shadowValid.assign(spotLights.size(), false);
+	
+	//enable depth testing
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::depthFunc(GL_LESS);
+	
+	return true;
+}
+
+void Graphics::allocateShadowTexture(GLuint texture) {
+	GLState::bindTexture(GL_TEXTURE_2D_ARRAY, texture);
+	
+	//glTextureStorage3D(texture, 1, GL_RGB16, m_menu.options.shadowSize, m_menu.options.shadowSize, spotLights.size());
 	glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT16, m_menu.options.shadowSize, m_menu.options.shadowSize, spotLights.size(), 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
@@ -96,21 +170,96 @@ bool Graphics::Initialize(int width, int height) {
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
 	glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_R_TO_TEXTURE);
+}
+
+void Graphics::buildInstanceGroups() {
+	std::vector<std::vector<Object*>> candidates;
 	
-	glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, spotlightShadowTexture, 0, 0);
+	for (auto& object : gameWorldCtx->worldObjects) {
+		const Object::Context& objCtx = object->ctx;
+		
+		//Only plain textured objects can share a draw - any other maps would each need their own array
+		if (objCtx.model == nullptr || objCtx.texture == nullptr || objCtx.altTexture != nullptr ||
+		    objCtx.normalMap != nullptr || objCtx.specularMap != nullptr) {
+			continue;
+		}
+		
+		bool found = false;
+		for (auto& i : candidates) {
+			const Object::Context& firstCtx = i[0]->ctx;
+			//Shaders are swapped all at once, so matching both keeps the group drawable with either
+			if (firstCtx.model == objCtx.model && firstCtx.shader == objCtx.shader && firstCtx.altShader == objCtx.altShader) {
+				i.push_back(object);
+				found = true;
+				break;
+			}
+		}
+		
+		if (!found) {
+			candidates.push_back(std::vector<Object*>(1, object));
+		}
+	}
 	
-	glDrawBuffer(GL_NONE);
+	for (auto& i : candidates) {
+		//Nothing to gain from a group of one
+		if (i.size() < 2) continue;
+		
+		std::vector<Texture*> layers;
+		for (auto& j : i) {
+			layers.push_back(j->ctx.texture);
+		}
+		
+		//Fails if the textures aren't all the same size
+		TextureArray* textures = TextureArray::create(layers);
+		if (textures == nullptr) continue;
+		
+		InstanceGroup group;
+		group.objects = i;
+		group.model = i[0]->ctx.model;
+		group.textures = textures;
+		
+		for (auto& j : i) {
+			j->ctx.instanceGroup = instanceGroups.size();
+		}
+		
+		instanceGroups.push_back(group);
+	}
+}
+
+GLsizei Graphics::updateInstances(InstanceGroup& group, bool pickableOnly, const Frustum* frustum) {
+	group.instances.clear();
+	group.screenSize = 0.0f;
 	
-	//enable depth testing
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	for (unsigned i = 0; i < group.objects.size(); i++) {
+		const Object* object = group.objects[i];
+		
+		if (pickableOnly && std::find(object->ctx.flags.begin(), object->ctx.flags.end(), "pickable") == object->ctx.flags.end()) {
+			continue;
+		}
+		if (frustum != nullptr && !frustum->intersectsSphere(object->boundCenter, object->boundRadius)) {
+			continue;
+		}
+		
+		InstanceData instance;
+		instance.model = object->GetModel();
+		instance.layer = i;
+		instance.id = object->ctx.id;
+		instance.highlight = object == highlighted ? 1.0f : 0.0f;
+		group.instances.push_back(instance);
+		
+		//Every instance is drawn at the same level, so the closest decides it
+		group.screenSize = std::max(group.screenSize, object->ScreenSize());
+	}
 	
-	return true;
+	GLState::bindBuffer(GL_ARRAY_BUFFER, group.instanceBuffer);
+	glBufferData(GL_ARRAY_BUFFER, sizeof(InstanceData) * group.instances.size(), group.instances.data(), GL_STREAM_DRAW);
+	
+	return group.instances.size();
 }
 
 void Graphics::updateScreenSize(int width, int height) {
-	glBindTexture(GL_TEXTURE_2D, pickTexture);
-	glBindFramebuffer(GL_FRAMEBUFFER, pickBuffer);
+	GLState::bindTexture(GL_TEXTURE_2D, pickTexture);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, pickBuffer);
 	
 	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA16F, width, height, 0, GL_RGBA, GL_FLOAT, NULL);
 	glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, pickTexture, 0);
@@ -224,14 +373,61 @@ void Graphics::Update(unsigned int dt) {
 }
 
 Object* Graphics::getObjectOnScreen(int x, int y, glm::vec3* location) {
+	if (m_menu.options.glPicking) {
+		return getObjectOnScreenGL(x, y, location);
+	}
+	
+	//The mouse unprojected onto the near and far planes gives a ray through everything under it
+	glm::vec4 viewport(0, 0, windowWidth, windowHeight);
+	glm::vec3 nearPoint = glm::unProject(glm::vec3(x, y, 0.0f), camView->GetView(), camView->GetProjection(), viewport);
+	glm::vec3 farPoint = glm::unProject(glm::vec3(x, y, 1.0f), camView->GetView(), camView->GetProjection(), viewport);
+	
+	physWorld->rayTest(btVector3(nearPoint.x, nearPoint.y, nearPoint.z), btVector3(farPoint.x, farPoint.y, farPoint.z), rayHits);
+	
+	for (const auto& hit : rayHits) {
+		Object* object = nullptr;
+		for (auto& i : gameWorldCtx->worldObjects) {
+			if (i->ctx.physicsBody == hit.body) {
+				object = i;
+				break;
+			}
+		}
+		
+		//Like the GPU pass, only pickable objects get in the way
+		if (object == nullptr || std::find(object->ctx.flags.begin(), object->ctx.flags.end(), "pickable") == object->ctx.flags.end()) {
+			continue;
+		}
+		
+		//The table hides what's behind it, but can't be picked itself
+		if (object == gameWorldCtx->worldObjects[0]) {
+			return nullptr;
+		}
+		
+		if (location != nullptr) {
+			location->x = hit.offset.x();
+			location->y = hit.offset.y();
+			location->z = hit.offset.z();
+		}
+		
+		return object;
+	}
+	
+	return nullptr;
+}
+
+void Graphics::setHighlighted(Object* object) {
+	highlighted = object;
+}
+
+Object* Graphics::getObjectOnScreenGL(int x, int y, glm::vec3* location) {
 	renderPick();
 	
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, pickBuffer);
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, pickBuffer);
 	glReadBuffer(GL_COLOR_ATTACHMENT0);
 	PixelInfo pixel;
 	glReadPixels(x, y, 1, 1, GL_RGBA, GL_FLOAT, &pixel);
 	glReadBuffer(GL_NONE);
-	glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 	
 	int id = pixel.a;
 	
@@ -259,111 +455,299 @@ void Graphics::addGuiBillboard(const glm::vec3& location, Texture* texture) {
 }
 
 void Graphics::Render() {
+	unsigned long heapAllocations = FrameArena::heapAllocations();
+	
+	//Everything from last frame's arena is done with
+	frameArena.reset();
+	
+	m_menu.stats = Menu::Stats();
+	
+	//Without background compiling, waiting on one program a frame spreads the hitches out
+	compileBudget = 1;
+	
+	//Lights, camera, and object matrices only change once per frame, so send them once
+	updateFrameUniforms();
+	updateObjectUniforms();
+	
 	if(m_menu.options.shadowSize != MENU_SHADOWS_NONE) renderShadows();
 	
 	//Switch to rendering on the screen
-	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, 0);
 	//clear the screen
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	
-	vector<float> spotLightPositions(spotLights.size() * 3);
-	vector<float> spotLightDirections(spotLights.size() * 3);
-	vector<float> spotLightColors(spotLights.size() * 3);
-	vector<float> spotLightAngles(spotLights.size());
-	vector<float> spotLightStrengths(spotLights.size());
+	if(m_menu.options.shadowSize != MENU_SHADOWS_NONE) {
+		GLState::bindTexture(GL_SHADOW_TEXTURE, GL_TEXTURE_2D_ARRAY, spotlightShadowTexture);
+	}
 	
-	glm::vec3 normalLightPoint;
-	for (unsigned i = 0; i < spotLights.size(); i++) {
-		spotLightPositions[i * 3 + 0] = spotLights[i]->position.x;
-		spotLightPositions[i * 3 + 1] = spotLights[i]->position.y;
-		spotLightPositions[i * 3 + 2] = spotLights[i]->position.z;
-
-		if(spotLights[i]->pointing != NULL)
-		{
-			normalLightPoint = glm::normalize(*spotLights[i]->pointing - spotLights[i]->position);
+	//Render planets
+	queueMainPass();
+	
+	Shader* shader = nullptr;
+	const Object* lastObject = nullptr; //Last object drawn with the current shader, whose textures are still bound
+	unsigned samples = shadowSamples();
+	for (const auto& item : mainQueue) {
+		if (item.object != -1) {
+			const Object* object = gameWorldCtx->worldObjects[item.object];
+			
+			Shader* objectShader = readyShader(object->GetShader(samples), object->Features(samples), false);
+			if (shader != objectShader) {
+				shader = objectShader;
+				useShader(shader);
+				//Sampler uniforms belong to the program, so they need setting again
+				lastObject = nullptr;
+			}
+			
+			objectUniforms->bind(item.object);
+			object->Render(shader, lastObject == nullptr || !object->SameTextures(lastObject));
+			lastObject = object;
+		} else {
+			InstanceGroup& group = instanceGroups[item.group];
+			
+			const Object* first = group.objects[0];
+			Shader* groupShader = readyShader(first->GetShader(samples)->instanced(), first->Features(samples), true);
+			if (shader != groupShader) {
+				shader = groupShader;
+				useShader(shader);
+				lastObject = nullptr;
+			}
+			
+			//Texture arrays have their own binding, so the 2D textures of lastObject stay bound
+			group.textures->bind(GL_COLOR_TEXTURE);
+			shader->uniform1i(UNIFORM_SAMPLER, GL_COLOR_TEXTURE_OFFSET);
+			
+			group.model->drawModelInstanced(shader, group.vaos, group.instances.size(), Model::selectLOD(group.screenSize, false));
 		}
+	}
+	
+	renderBillboards();
+	billboards.clear();
+	
+	//This frame's uniform data can be reused once these draws are done
+	frameUniforms->fence();
+	objectUniforms->fence();
+	
+	m_menu.stats.arenaUsed = frameArena.used();
+	m_menu.stats.arenaCapacity = frameArena.capacity();
+	m_menu.stats.heapAllocations = FrameArena::heapAllocations() - heapAllocations;
+	
+	//Picking between frames is counted with the next one
+	const GLState::Counters& counters = GLState::counters();
+	m_menu.stats.drawCalls = counters.drawCalls;
+	m_menu.stats.stateChanges = counters.stateChanges;
+	m_menu.stats.redundantStates = counters.redundant;
+	m_menu.stats.uniformUploads = counters.uniformUploads;
+	GLState::resetCounters();
+	
+	//OpenGL errors are reported by GLState::enableDebugOutput() in OPENGL_DEBUG builds, rather than stalling on glGetError() every frame
+}
 
+//Textures an object binds, packed down for a sort key
+//Objects which share all their textures get the same number
+static unsigned textureSetKey(const Object::Context& objCtx) {
+	unsigned key = 0;
+	
+	const Texture* textures[] = {objCtx.texture, objCtx.altTexture, objCtx.normalMap, objCtx.specularMap};
+	for (const auto& i : textures) {
+		key = key * 31 + (i != nullptr ? i->getSortID() : 0);
+	}
+	
+	//The top bit is kept for instance groups' texture arrays
+	return key & 0x7FFF;
+}
+
+void Graphics::queueMainPass() {
+	mainQueue.clear(frameArena, gameWorldCtx->worldObjects.size() + instanceGroups.size());
+	
+	const glm::vec3& eye = camView->eyePos;
+	Frustum frustum(camView->GetProjection() * camView->GetView());
+	unsigned samples = shadowSamples();
+	
+	for (int i = 0; i < gameWorldCtx->worldObjects.size(); i++) {
+		const Object* object = gameWorldCtx->worldObjects[i];
+		//Drawn with the rest of their group
+		if (object->ctx.instanceGroup != -1) continue;
 		
-		spotLightDirections[i * 3 + 0] = normalLightPoint.x;
-		spotLightDirections[i * 3 + 1] = normalLightPoint.y;
-		spotLightDirections[i * 3 + 2] = normalLightPoint.z;
+		if (!frustum.intersectsSphere(object->boundCenter, object->boundRadius)) {
+			m_menu.stats.culled++;
+			continue;
+		}
+		m_menu.stats.drawn++;
 		
-		spotLightColors[i * 3 + 0] = spotLights[i]->color.x;
-		spotLightColors[i * 3 + 1] = spotLights[i]->color.y;
-		spotLightColors[i * 3 + 2] = spotLights[i]->color.z;
+		//Front to back, so hidden pixels fail the depth test before shading
+		float depth = glm::length(object->position - eye) / FAR_FRUSTRUM;
 		
-		spotLightAngles[i] = cos(spotLights[i]->angle);
-		spotLightStrengths[i] = spotLights[i]->strength;
-		if(spotLights[i]->isBumperLight && spotLights[i]->timer <= 0) {
-			spotLightStrengths[i] = 0;
-		}
+		Shader* shader = readyShader(object->GetShader(samples), object->Features(samples), false);
+		mainQueue.push(RenderQueue::makeKey(RENDER_PASS_MAIN, shader->GetSortID(), textureSetKey(object->ctx),
+		                                    object->ctx.model->getSortID(), depth), i, -1);
 	}
 	
+	for (unsigned i = 0; i < instanceGroups.size(); i++) {
+		InstanceGroup& group = instanceGroups[i];
+		
+		//Only the instances on screen are sent
+		GLsizei count = updateInstances(group, false, &frustum);
+		m_menu.stats.drawn += count;
+		m_menu.stats.culled += group.objects.size() - count;
+		if (count == 0) continue;
+		
+		const Object* first = group.objects[0];
+		Shader* shader = readyShader(first->GetShader(samples)->instanced(), first->Features(samples), true);
+		mainQueue.push(RenderQueue::makeKey(RENDER_PASS_MAIN, shader->GetSortID(), 0x8000 | i,
+		                                    group.model->getSortID(), 0.0f), -1, i);
+	}
 	
-	//Render planets
-	// Update the object
-	Shader* shader = nullptr;
+	mainQueue.sort();
+}
+
+void Graphics::queueShadowPass() {
+	shadowQueue.clear(frameArena, gameWorldCtx->worldObjects.size() + instanceGroups.size());
+	staticShadowQueue.clear(frameArena, gameWorldCtx->worldObjects.size() + instanceGroups.size());
+	
+	//Depth only, so textures don't matter - just keep draws of the same model together
 	for (int i = 0; i < gameWorldCtx->worldObjects.size(); i++) {
-		if (shader != gameWorldCtx->worldObjects[i]->ctx.shader) {
-			shader = gameWorldCtx->worldObjects[i]->ctx.shader;
-			shader->Enable();
-			
-			shader->uniform3fv("spotLightPositions", spotLightStrengths.size(), &spotLightPositions[0]);
-			shader->uniform3fv("spotLightDirections", spotLightStrengths.size(), &spotLightDirections[0]);
-			shader->uniform3fv("spotLightColors", spotLightStrengths.size(), &spotLightColors[0]);
-			shader->uniform1fv("spotLightStrengths", spotLightStrengths.size(), &spotLightStrengths[0]);
-			shader->uniform1fv("spotLightAngles", spotLightStrengths.size(), &spotLightAngles[0]);
-			
-			shader->uniform3fv("AmbientLight", 1, &m_menu.options.ambientColor.r);
-			
-			shader->uniformMatrix4fv("viewMatrix", 1, GL_FALSE, glm::value_ptr(camView->GetView()));
-			shader->uniformMatrix4fv("projectionMatrix", 1, GL_FALSE, glm::value_ptr(camView->GetProjection()));
-			
-			if(m_menu.options.shadowSize != MENU_SHADOWS_NONE) {
-				glActiveTexture(GL_SHADOW_TEXTURE);
-				glBindTexture(GL_TEXTURE_2D_ARRAY, spotlightShadowTexture);
-				
-				int samples = 1;
-				switch(m_menu.options.shadowSize) {
-					case MENU_SHADOWS_LOW:
-						samples = 2;
-						break;
-					case MENU_SHADOWS_MED:
-						samples = 4;
-						break;
-					case MENU_SHADOWS_HIGH:
-						samples = 8;
-						break;
-				}
-				
-				shader->uniform1i("numShadowSamples", samples);
-				shader->uniform1i("spotlightShadowSampler", GL_SHADOW_TEXTURE_OFFSET);
+		const Object* object = gameWorldCtx->worldObjects[i];
+		if (object->ctx.instanceGroup != -1) continue;
+		
+		RenderQueue& queue = object->IsDynamic() ? shadowQueue : staticShadowQueue;
+		queue.push(RenderQueue::makeKey(RENDER_PASS_SHADOW, shadowShader->GetSortID(), 0, object->ctx.model->getSortID(), 0.0f), i, -1);
+	}
+	
+	for (unsigned i = 0; i < instanceGroups.size(); i++) {
+		const InstanceGroup& group = instanceGroups[i];
+		
+		//One dynamic object is enough to have to redraw the whole group
+		bool dynamic = false;
+		for (const auto& j : group.objects) {
+			dynamic = dynamic || j->IsDynamic();
+		}
+		
+		RenderQueue& queue = dynamic ? shadowQueue : staticShadowQueue;
+		queue.push(RenderQueue::makeKey(RENDER_PASS_SHADOW, shadowShader->instanced()->GetSortID(), 0, group.model->getSortID(), 0.0f), -1, i);
+	}
+	
+	shadowQueue.sort();
+	staticShadowQueue.sort();
+}
+
+unsigned Graphics::shadowSamples() const {
+	switch(m_menu.options.shadowSize) {
+		case MENU_SHADOWS_LOW:
+			return 2;
+		case MENU_SHADOWS_MED:
+			return 4;
+		case MENU_SHADOWS_HIGH:
+			return 8;
+		default:
+			return 0;
+	}
+}
+
+Shader* Graphics::readyShader(Shader* wanted, const ShaderFeatures& features, bool instanced) {
+	wanted->InitializeAsync(&shaderDictionary);
+	if (wanted->IsReady()) return wanted;
+	
+	//No way to tell if it's done without waiting, so wait on a few and draw the rest unlit
+	if (!Shader::ParallelCompileSupported() && compileBudget > 0) {
+		compileBudget--;
+		if (wanted->IsReady(true)) return wanted;
+	}
+	
+	//Only the texture matters to the fallback
+	ShaderFeatures fallbackFeatures;
+	fallbackFeatures.hasTexture = features.hasTexture;
+	
+	return instanced ? fallbackShader->instanced() : fallbackShader->variant(fallbackFeatures);
+}
+
+void Graphics::useShader(Shader* shader) {
+	shader->Initialize(&shaderDictionary);
+	shader->Enable();
+	
+	//Everything else comes from the uniform buffers
+	shader->uniform1i(UNIFORM_SPOTLIGHT_SHADOW_SAMPLER, GL_SHADOW_TEXTURE_OFFSET);
+}
+
+void Graphics::updateFrameUniforms() {
+	FrameDataLayout layout(spotLights.size());
+	
+	frameUniforms->write(0, layout.viewMatrix, glm::value_ptr(camView->GetView()), sizeof(glm::mat4));
+	frameUniforms->write(0, layout.projectionMatrix, glm::value_ptr(camView->GetProjection()), sizeof(glm::mat4));
+	frameUniforms->write(0, layout.ambientLight, &m_menu.options.ambientColor.r, sizeof(glm::vec3));
+	
+	glm::mat4 viewMatrix;
+	glm::mat4 projMatrix;
+	glm::vec3 normalLightPoint;
+	for (unsigned i = 0; i < spotLights.size(); i++) {
+		//View-Projection matrix of the light, for shadows
+		if(spotLights[i]->pointing != NULL)
+		{
+			if(spotLights[i]->position.x != spotLights[i]->pointing->x || spotLights[i]->position.x != spotLights[i]->pointing->z) {
+				viewMatrix = glm::lookAt(spotLights[i]->position, *spotLights[i]->pointing, glm::vec3(0.0, 1.0, 0.0));
 			} else {
-				shader->uniform1i("numShadowSamples", 0);
+				viewMatrix = glm::lookAt(spotLights[i]->position, *spotLights[i]->pointing, glm::vec3(0.01, 1.0, 0.0));
 			}
 		}
 		
-		gameWorldCtx->worldObjects[i]->Render(m_menu.options.shadowSize != MENU_SHADOWS_NONE, spotlightMatrices);
+		projMatrix = glm::perspective(spotLights[i]->angle * 2.25f, 1.0f, 1.0f, 200.0f);
+		
+		spotlightMatrices[i] = projMatrix * viewMatrix;
+		
+		if(spotLights[i]->pointing != NULL)
+		{
+			normalLightPoint = glm::normalize(*spotLights[i]->pointing - spotLights[i]->position);
+		}
+		
+		float angle = cos(spotLights[i]->angle);
+		float strength = spotLights[i]->strength;
+		if(spotLights[i]->isBumperLight && spotLights[i]->timer <= 0) {
+			strength = 0;
+		}
+		
+		frameUniforms->write(0, layout.spotlightMatrices + 64 * i, glm::value_ptr(spotlightMatrices[i]), sizeof(glm::mat4));
+		frameUniforms->write(0, layout.spotLightPositions + 16 * i, &spotLights[i]->position.x, sizeof(glm::vec3));
+		frameUniforms->write(0, layout.spotLightDirections + 16 * i, &normalLightPoint.x, sizeof(glm::vec3));
+		frameUniforms->write(0, layout.spotLightColors + 16 * i, &spotLights[i]->color.x, sizeof(glm::vec3));
+		frameUniforms->write(0, layout.spotLightStrengths + 16 * i, &strength, sizeof(float));
+		frameUniforms->write(0, layout.spotLightAngles + 16 * i, &angle, sizeof(float));
 	}
 	
-	renderBillboards();
-	billboards.clear();
+	frameUniforms->upload(1);
+	frameUniforms->bind(0);
+}
+
+void Graphics::updateObjectUniforms() {
+	ObjectDataLayout layout(spotLights.size());
 	
-	// Get any errors from OpenGL
-	auto error = glGetError();
-	if (error != GL_NO_ERROR) {
-		std::string val = ErrorString(error);
-		std::cout << "Error initializing OpenGL! " << error << ", " << val << std::endl;
+	for (unsigned i = 0; i < gameWorldCtx->worldObjects.size(); i++) {
+		const Object* object = gameWorldCtx->worldObjects[i];
+		//Instanced objects get their matrices from the instance buffer
+		if (object->ctx.instanceGroup != -1) continue;
+		
+		const glm::mat4& modelMatrix = object->GetModel();
+		glm::mat4 modelViewMatrix = camView->GetView() * modelMatrix;
+		objectUniforms->write(i, layout.modelMatrix, glm::value_ptr(modelMatrix), sizeof(glm::mat4));
+		objectUniforms->write(i, layout.modelViewMatrix, glm::value_ptr(modelViewMatrix), sizeof(glm::mat4));
+		
+		float highlight = object == highlighted ? 1.0f : 0.0f;
+		objectUniforms->write(i, layout.highlight, &highlight, sizeof(float));
+		
+		for (unsigned j = 0; j < spotlightMatrices.size(); j++) {
+			glm::mat4 biasMVP = spotlightMatrices[j] * modelMatrix;
+			objectUniforms->write(i, layout.biasMVP + 64 * j, glm::value_ptr(biasMVP), sizeof(glm::mat4));
+		}
 	}
+	
+	objectUniforms->upload(gameWorldCtx->worldObjects.size());
 }
 
 void Graphics::renderPick() {
 	pickShader->Enable();
 	
-	glBindFramebuffer(GL_FRAMEBUFFER, pickBuffer);
+	GLState::bindFramebuffer(GL_FRAMEBUFFER, pickBuffer);
 	
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::depthFunc(GL_LESS);
 	
 	glDrawBuffer(GL_COLOR_ATTACHMENT0);
 	glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
@@ -371,59 +755,150 @@ void Graphics::renderPick() {
 	for (int i = 0; i < gameWorldCtx->worldObjects.size(); i++) {
 		auto& flags = gameWorldCtx->worldObjects[i]->ctx.flags;
 		
-		if(std::find(flags.begin(), flags.end(), "pickable") != flags.end()) {
+		if(gameWorldCtx->worldObjects[i]->ctx.instanceGroup == -1 && std::find(flags.begin(), flags.end(), "pickable") != flags.end()) {
 			gameWorldCtx->worldObjects[i]->RenderID(pickShader);
 		}
 	}
+	
+	if (!instanceGroups.empty()) {
+		Shader* instancedPickShader = pickShader->instanced();
+		instancedPickShader->Enable();
+		
+		//Model matrices come from the instances
+		glm::mat4 viewProjection = camView->GetProjection() * camView->GetView();
+		instancedPickShader->uniformMatrix4fv(UNIFORM_MVP, 1, GL_FALSE, glm::value_ptr(viewProjection));
+		
+		for (auto& group : instanceGroups) {
+			GLsizei count = updateInstances(group, true);
+			if (count > 0) {
+				group.model->drawModelInstanced(nullptr, group.depthVaos, count, Model::selectLOD(group.screenSize, false));
+			}
+		}
+	}
 }
 
 void Graphics::renderShadows() {
 	if(m_menu.options.changedShadowSize) {
-		glBindTexture(GL_TEXTURE_2D_ARRAY, spotlightShadowTexture);
-		glTexImage3D(GL_TEXTURE_2D_ARRAY, 0, GL_DEPTH_COMPONENT16, m_menu.options.shadowSize, m_menu.options.shadowSize, spotLights.size(), 0, GL_DEPTH_COMPONENT, GL_FLOAT, 0);
+		allocateShadowTexture(spotlightShadowTexture);
+		allocateShadowTexture(staticShadowTexture);
+		staticShadowValid.assign(spotLights.size(), false);
+		shadowValid.assign(spotLights.size(), false);
 	}
 	
-	shadowShader->Enable();
+	bool dynamicMoved = false;
+	bool staticMoved = false;
+	for (const auto& i : gameWorldCtx->worldObjects) {
+		if (i->Moved()) {
+			if (i->IsDynamic()) {
+				dynamicMoved = true;
+			} else {
+				staticMoved = true;
+			}
+		}
+	}
 	
-	glm::mat4 viewMatrix;
-	glm::mat4 projMatrix;
+	//Work out which layers need drawing first, so a frame where nothing moved doesn't touch OpenGL at all
+	bool* drawStatic = frameArena.allocate<bool>(spotLights.size());
+	bool* drawLayer = frameArena.allocate<bool>(spotLights.size());
+	bool drawAny = false;
+	for (unsigned i = 0; i < spotLights.size(); i++) {
+		drawStatic[i] = false;
+		drawLayer[i] = false;
+		
+		if (spotLights[i]->isBumperLight && spotLights[i]->timer == 0) {
+			//Things may move while the light is off, so start fresh when it comes back on
+			if (dynamicMoved || staticMoved) shadowValid[i] = false;
+			continue;
+		}
+		
+		if (staticMoved || staticShadowMatrices[i] != spotlightMatrices[i]) {
+			staticShadowValid[i] = false;
+		}
+		
+		drawStatic[i] = !staticShadowValid[i];
+		drawLayer[i] = drawStatic[i] || dynamicMoved || !shadowValid[i];
+		drawAny = drawAny || drawLayer[i];
+	}
+	
+	if (!drawAny) return;
 	
-	glBindFramebuffer(GL_FRAMEBUFFER, spotlightShadowBuffer);
-	glViewport(0, 0, m_menu.options.shadowSize, m_menu.options.shadowSize);
+	GLState::viewport(0, 0, m_menu.options.shadowSize, m_menu.options.shadowSize);
 	
-	glCullFace(GL_BACK);
+	GLState::cullFace(GL_BACK);
 	
-	glEnable(GL_DEPTH_TEST);
-	glDepthFunc(GL_LESS);
+	GLState::enable(GL_DEPTH_TEST);
+	GLState::depthFunc(GL_LESS);
+	
+	queueShadowPass();
 	
 	for(int i = 0; i < spotLights.size(); i++) {
-		if(spotLights[i]->isBumperLight && spotLights[i]->timer == 0) {
-			continue;
+		if (drawStatic[i]) {
+			GLState::bindFramebuffer(GL_FRAMEBUFFER, staticShadowBuffer);
+			glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticShadowTexture, 0, i);
+			glClear(GL_DEPTH_BUFFER_BIT);
+			
+			drawShadowQueue(staticShadowQueue, i);
+			
+			staticShadowMatrices[i] = spotlightMatrices[i];
+			staticShadowValid[i] = true;
 		}
+		
+		if (!drawLayer[i]) continue;
+		
+		//Start from the cached static casters instead of a cleared layer
+		GLState::bindFramebuffer(GL_READ_FRAMEBUFFER, staticShadowBuffer);
+		glFramebufferTextureLayer(GL_READ_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, staticShadowTexture, 0, i);
+		GLState::bindFramebuffer(GL_DRAW_FRAMEBUFFER, spotlightShadowBuffer);
+		glFramebufferTextureLayer(GL_DRAW_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, spotlightShadowTexture, 0, i);
+		glBlitFramebuffer(0, 0, m_menu.options.shadowSize, m_menu.options.shadowSize,
+		                  0, 0, m_menu.options.shadowSize, m_menu.options.shadowSize, GL_DEPTH_BUFFER_BIT, GL_NEAREST);
+		
+		GLState::bindFramebuffer(GL_FRAMEBUFFER, spotlightShadowBuffer);
+		drawShadowQueue(shadowQueue, i);
+		
+		shadowValid[i] = true;
+	}
+	
+	GLState::viewport(0, 0, windowWidth, windowHeight);
+}
 
-		if(spotLights[i] != nullptr && spotLights[i]->pointing != NULL)
-		{
-			if(spotLights[i]->position.x != spotLights[i]->pointing->x || spotLights[i]->position.x != spotLights[i]->pointing->z) {
-				viewMatrix = glm::lookAt(spotLights[i]->position, *spotLights[i]->pointing, glm::vec3(0.0, 1.0, 0.0));
-			} else {
-				viewMatrix = glm::lookAt(spotLights[i]->position, *spotLights[i]->pointing, glm::vec3(0.01, 1.0, 0.0));
+void Graphics::drawShadowQueue(const RenderQueue& queue, unsigned light) {
+	//Nothing outside the light's cone can cast a shadow it sees
+	Frustum frustum(spotlightMatrices[light]);
+	
+	//The light's matrices are already in the frame and object uniform buffers
+	Shader* shader = nullptr;
+	for (const auto& item : queue) {
+		GLsizei count = 1;
+		if (item.object != -1) {
+			const Object* object = gameWorldCtx->worldObjects[item.object];
+			if (!frustum.intersectsSphere(object->boundCenter, object->boundRadius)) {
+				count = 0;
 			}
+			m_menu.stats.shadowCulled += 1 - count;
+		} else {
+			InstanceGroup& group = instanceGroups[item.group];
+			count = updateInstances(group, false, &frustum);
+			m_menu.stats.shadowCulled += group.objects.size() - count;
 		}
+		m_menu.stats.shadowDrawn += count;
+		if (count == 0) continue;
 		
-		projMatrix = glm::perspective(spotLights[i]->angle * 2.25f, 1.0f, 1.0f, 200.0f);
-		
-		spotlightMatrices[i] = projMatrix * viewMatrix;
-		
-		glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, spotlightShadowTexture, 0, i);
-		//glDrawBuffer(GL_COLOR_ATTACHMENT0);
-		glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+		Shader* itemShader = item.object != -1 ? shadowShader : shadowShader->instanced();
+		if (shader != itemShader) {
+			shader = itemShader;
+			shader->Enable();
+			shader->uniform1i(UNIFORM_LIGHT_INDEX, light);
+		}
 		
-		for (int j = 0; j < gameWorldCtx->worldObjects.size(); j++) {
-			gameWorldCtx->worldObjects[j]->RenderShadow(shadowShader, spotlightMatrices[i]);
+		if (item.object != -1) {
+			objectUniforms->bind(item.object);
+			gameWorldCtx->worldObjects[item.object]->RenderShadow();
+		} else {
+			InstanceGroup& group = instanceGroups[item.group];
+			group.model->drawModelInstanced(nullptr, group.depthVaos, count, Model::selectLOD(group.screenSize, true));
 		}
 	}
-	
-	glViewport(0, 0, windowWidth, windowHeight);
 }
 
 void Graphics::renderBillboards() {
@@ -439,34 +914,17 @@ void Graphics::renderBillboards() {
 	billboardShader->Enable();
 	
 	if(billboards.size() > 0) {
-		glEnable(GL_BLEND);
-		glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+		GLState::enable(GL_BLEND);
+		GLState::blendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 		float aspectRatio = -( windowHeight / float(windowWidth));
 		for (const auto& i : billboards) {
 			i.second->bind(GL_COLOR_TEXTURE);
-			billboardShader->uniform1i("gSampler", GL_COLOR_TEXTURE_OFFSET);
-			billboardShader->uniform1fv("aspect", 1, &aspectRatio);
-			billboardShader->uniform3fv("billboardLocation", 1, &i.first.x);
+			billboardShader->uniform1i(UNIFORM_SAMPLER, GL_COLOR_TEXTURE_OFFSET);
+			billboardShader->uniform1fv(UNIFORM_ASPECT, 1, &aspectRatio);
+			billboardShader->uniform3fv(UNIFORM_BILLBOARD_LOCATION, 1, &i.first.x);
 			billboardModel->drawModel(nullptr);
 		}
-		glBindTexture(GL_TEXTURE_2D, 0);
-		glDisable(GL_BLEND);
-	}
-}
-
-std::string Graphics::ErrorString(GLenum error) {
-	if (error == GL_INVALID_ENUM) {
-		return "GL_INVALID_ENUM: An unacceptable value is specified for an enumerated argument.";
-	} else if (error == GL_INVALID_VALUE) {
-		return "GL_INVALID_VALUE: A numeric argument is out of range.";
-	} else if (error == GL_INVALID_OPERATION) {
-		return "GL_INVALID_OPERATION: The specified operation is not allowed in the current state.";
-	} else if (error == GL_INVALID_FRAMEBUFFER_OPERATION) {
-		return "GL_INVALID_FRAMEBUFFER_OPERATION: The framebuffer object is not complete.";
-	} else if (error == GL_OUT_OF_MEMORY) {
-		return "GL_OUT_OF_MEMORY: There is not enough memory left to execute the command.";
-	} else {
-		return "None";
+		GLState::disable(GL_BLEND);
 	}
 }
 
@@ -0,0 +1,62 @@
+#include "job_pool.h"
+
+JobPool::JobPool(unsigned threads) : m_stopping(false) {
+	if(threads == 0) {
+		threads = std::thread::hardware_concurrency();
+	}
+	//hardware_concurrency() is allowed to not know
+	if(threads == 0) {
+		threads = 1;
+	}
+	
+	for(unsigned i = 0; i < threads; i++) {
+		m_workers.push_back(std::thread(&JobPool::work, this));
+	}
+}
+
+JobPool::~JobPool() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	
+	for(auto& i : m_workers) {
+		i.join();
+	}
+}
+
+unsigned JobPool::size() const {
+	return m_workers.size();
+}
+
+void JobPool::push(std::function<void()> job) {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_jobs.push_back(job);
+	}
+	m_wake.notify_one();
+}
+
+void JobPool::work() {
+	while(true) {
+		std::function<void()> job;
+		
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			while(m_jobs.empty() && !m_stopping) {
+				m_wake.wait(lock);
+			}
+			
+			//Only stop once everything queued is done
+			if(m_jobs.empty()) {
+				return;
+			}
+			
+			job = m_jobs.front();
+			m_jobs.pop_front();
+		}
+		
+		job();
+	}
+}
@@ -29,6 +29,16 @@ int main(int argc, char** argv) {
 		return exit;
 	}
 	
+	//Time the physics on its own, hitting the cue ball into the rest without drawing anything
+	if (argc > 2 && !strcmp(argv[2], "--benchmark-physics")) {
+		int cueBall = gameCtx->worldObjects[gameCtx->cueBall]->ctx.rigidBodyIndex;
+		ctx.physWorld->benchmark(cueBall, btVector3(-25, 0, 0), PHYSICS_BENCHMARK_STEPS);
+		
+		delete ctx.physWorld;
+		ctx.physWorld = nullptr;
+		return 0;
+	}
+	
 	// Start an engine and run it then cleanup after
 	Engine* engine = new Engine(ctx);
 	if (!engine->Initialize()) {
@@ -78,11 +88,6 @@ int processConfig(int argc, char** argv, json& config, Engine::Context& ctx) {
 		helpMenu();
 		return 0;
 	} else {
-		// Add the physics world (not defined in config)
-		PhysicsWorld* physWorld = new PhysicsWorld();
-
-		ctx.physWorld = physWorld;
-		
 		//Load and process config file
 		ifstream configFile(argv[1]);
 		if (!configFile.is_open()) {
@@ -92,6 +97,18 @@ int processConfig(int argc, char** argv, json& config, Engine::Context& ctx) {
 		
 		config << configFile;
 		
+		//Add the physics world, multithreaded if the config asks for it
+		bool multithreadedPhysics = false;
+		unsigned physicsThreads = 0;
+		if (config.find("multithreaded-physics") != config.end()) {
+			multithreadedPhysics = config["multithreaded-physics"];
+		}
+		if (config.find("physics-threads") != config.end()) {
+			physicsThreads = config["physics-threads"];
+		}
+		PhysicsWorld* physWorld = new PhysicsWorld(multithreadedPhysics, physicsThreads);
+		ctx.physWorld = physWorld;
+		
 		//Window properties
 		//I don't think fullscreen works yet - maybe eventually
 		ctx.height = config["window"]["height"];
@@ -99,6 +116,11 @@ int processConfig(int argc, char** argv, json& config, Engine::Context& ctx) {
 		ctx.fullscreen = config["window"]["fullscreen"];
 		ctx.name = "Pinball";
 		
+		//Higher keeps models at full detail from further away
+		if (config.find("lod-bias") != config.end()) {
+			Model::lodBias = config["lod-bias"];
+		}
+		
 		//The configuration of the game world
 		std::string vertexLocation = config["default_shaders"]["vertex"];
 		std::string fragLocation = config["default_shaders"]["fragment"];
@@ -108,12 +130,20 @@ int processConfig(int argc, char** argv, json& config, Engine::Context& ctx) {
 		fragLocation = config["default_alt_shaders"]["fragment"];
 		Shader* defaultAltShader = Shader::load("shaders/" + vertexLocation, "shaders/" + fragLocation);
 		
+		//Start every model and texture loading at once, one per core
+		//The objects below then wait for just the files they need
+		JobPool loaderPool;
+		AssetLoader loader(loaderPool);
+		for (auto& i : config["game_objects"]) {
+			requestObjectAssets(i, loader);
+		}
+		
 		//Load the gameworld's objects
 		int j = 0;
 		int k = 0;
 		for (auto& i : config["game_objects"]) {
 			Object::Context objCtx;
-			error = loadObjectContext(i, objCtx, defaultShader, defaultAltShader, physWorld);
+			error = loadObjectContext(i, objCtx, defaultShader, defaultAltShader, physWorld, loader);
 			if (error != -1) return error;
 			Object* newObject = new Object(objCtx);
 			gameCtx->worldObjects.push_back(newObject);
@@ -171,7 +201,28 @@ int processConfig(int argc, char** argv, json& config, Engine::Context& ctx) {
 	return -1;
 }
 
-int loadObjectContext(json& config, Object::Context& ctx, Shader* defaultShader, Shader* defaultAltShader, PhysicsWorld* physWorld) {
+void requestObjectAssets(json& config, AssetLoader& loader) {
+	std::string filename;
+	
+	if (config.find("model") != config.end()) {
+		filename = config["model"];
+		loader.requestModel("models/" + filename);
+	}
+	if (config.find("collision-mesh") != config.end()) {
+		filename = config["collision-mesh"];
+		loader.requestModel("models/" + filename);
+	}
+	
+	const char* textureKeys[] = {"texture", "alt-texture", "normal-texture", "specular-texture"};
+	for (const auto& i : textureKeys) {
+		if (config.find(i) != config.end()) {
+			filename = config[i];
+			loader.requestTexture("textures/" + filename, std::string(i) == "normal-texture");
+		}
+	}
+}
+
+int loadObjectContext(json& config, Object::Context& ctx, Shader* defaultShader, Shader* defaultAltShader, PhysicsWorld* physWorld, AssetLoader& loader) {
 	
 	PhysicsWorld::Context objectPhysics;
 	objectPhysics.flags = &ctx.flags;
@@ -263,37 +314,25 @@ int loadObjectContext(json& config, Object::Context& ctx, Shader* defaultShader,
 	if (config.find("model") != config.end()) {
 		filename = config["model"];
 		
-		ctx.model = Model::load("models/" + filename);
+		ctx.model = loader.getModel("models/" + filename);
 		
 		if (ctx.model == nullptr) {
 			std::cout << ctx.name << " Could not load model file " << config["model"] << std::endl;
 			return 1;
 		}
-		btTriangleMesh* objTriMesh = new btTriangleMesh();
-		Model* collisionMesh = ctx.model;
+		//Bodies which aren't a simple shape collide with their model, or a simpler one made for it
 		if(config.find("collision-mesh") != config.end()) {
 			filename = config["collision-mesh"];
 			
-			collisionMesh = Model::load("models/" + filename);
+			objectPhysics.mesh = loader.getModel("models/" + filename);
 			ctx.shape = 0;
+		} else {
+			objectPhysics.mesh = ctx.model;
 		}
+		objectPhysics.meshFile = "models/" + filename;
+		objectPhysics.meshScale = btVector3(ctx.scale.x, ctx.scale.y, ctx.scale.z);
 		
-		if(ctx.shape > 4 || ctx.shape <= 0)
-		{
-			for(const auto& m : collisionMesh->meshes) {
-				for(int i = 0; i < m._indices.size() / 3; i++) {
-					btVector3 triArray[3];
-					for(int j = 0; j < 3; j++) {
-						glm::vec3 position = m._vertices[m._indices[3 * i + j]].vertex;
-						triArray[j] = btVector3(position.x*ctx.scale.x, position.y*ctx.scale.y, position.z*ctx.scale.z);
-					}
-					
-					objTriMesh->addTriangle(triArray[0], triArray[1], triArray[2]);
-				}
-			}
-		}
-		
-		ctx.rigidBodyIndex = physWorld->createObject(ctx.name, objTriMesh, &objectPhysics);
+		ctx.rigidBodyIndex = physWorld->createObject(ctx.name, &objectPhysics);
 		
 		ctx.physicsBody = (*(physWorld->getLoadedBodies()))[ctx.rigidBodyIndex];
 	} else {
@@ -304,7 +343,7 @@ int loadObjectContext(json& config, Object::Context& ctx, Shader* defaultShader,
 	//Check if the object has a texture
 	if (config.find("texture") != config.end()) {
 		filename = config["texture"];
-		ctx.texture = Texture::load("textures/" + filename);
+		ctx.texture = loader.getTexture("textures/" + filename);
 	} else {
 		ctx.texture = nullptr;
 	}
@@ -312,7 +351,7 @@ int loadObjectContext(json& config, Object::Context& ctx, Shader* defaultShader,
 	//Night-time/Alternative texture
 	if (config.find("alt-texture") != config.end()) {
 		filename = config["alt-texture"];
-		ctx.altTexture = Texture::load("textures/" + filename);
+		ctx.altTexture = loader.getTexture("textures/" + filename);
 	} else {
 		ctx.altTexture = nullptr;
 	}
@@ -320,7 +359,7 @@ int loadObjectContext(json& config, Object::Context& ctx, Shader* defaultShader,
 	//Normal Map texture
 	if (config.find("normal-texture") != config.end()) {
 		filename = config["normal-texture"];
-		ctx.normalMap = Texture::load("textures/" + filename);
+		ctx.normalMap = loader.getTexture("textures/" + filename, true);
 	} else {
 		ctx.normalMap = nullptr;
 	}
@@ -328,7 +367,7 @@ int loadObjectContext(json& config, Object::Context& ctx, Shader* defaultShader,
 	//Specular map texture
 	if (config.find("specular-texture") != config.end()) {
 		filename = config["specular-texture"];
-		ctx.specularMap = Texture::load("textures/" + filename);
+		ctx.specularMap = loader.getTexture("textures/" + filename);
 	} else {
 		ctx.specularMap = nullptr;
 	}
@@ -423,7 +462,9 @@ void helpMenu() {
 	          << "    " << PROGRAM_NAME << " --help" << std::endl
 	          << "        Show help menu and command usage" << std::endl
 	          << "    " << PROGRAM_NAME << " <filename>" << std::endl
-	          << "        Run program with specified config file" << std::endl;
+	          << "        Run program with specified config file" << std::endl
+	          << "    " << PROGRAM_NAME << " <filename> --benchmark-physics" << std::endl
+	          << "        Time stepping the config's physics without drawing it, then exit" << std::endl;
 }
 
 std::ostream& operator<<(std::ostream& stream, const glm::vec3 & vector) {
@@ -0,0 +1,65 @@
+#include "mapped_file.h"
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+MappedFile::MappedFile() : m_data(nullptr), m_size(0) {}
+
+MappedFile::~MappedFile() {
+	close();
+}
+
+bool MappedFile::open(const std::string& filename) {
+	close();
+	
+	int file = ::open(filename.c_str(), O_RDONLY);
+	if(file < 0) {
+		return false;
+	}
+	
+	struct stat info;
+	if(fstat(file, &info) != 0 || info.st_size <= 0) {
+		::close(file);
+		return false;
+	}
+	
+	void* data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+	//The mapping stays valid after the file is closed
+	::close(file);
+	
+	if(data == MAP_FAILED) {
+		return false;
+	}
+	
+	m_data = static_cast<unsigned char*>(data);
+	m_size = info.st_size;
+	
+	return true;
+}
+
+void MappedFile::close() {
+	if(m_data != nullptr) {
+		munmap(m_data, m_size);
+		m_data = nullptr;
+		m_size = 0;
+	}
+}
+
+const unsigned char* MappedFile::data() const {
+	return m_data;
+}
+
+size_t MappedFile::size() const {
+	return m_size;
+}
+
+uint64_t MappedFile::hash() const {
+	uint64_t hash = 14695981039346656037ull;
+	for(size_t i = 0; i < m_size; i++) {
+		hash = (hash ^ m_data[i]) * 1099511628211ull;
+	}
+	
+	return hash;
+}
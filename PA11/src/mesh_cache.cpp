@@ -0,0 +1,256 @@
+#include "mesh_cache.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
+
+bool MeshCache::describeSource(const std::string& modelFile, Header& header) {
+	struct stat info;
+	if(stat(modelFile.c_str(), &info) != 0) {
+		return false;
+	}
+	
+	header.magic = MESH_CACHE_MAGIC;
+	header.version = MESH_CACHE_VERSION;
+	header.vertexSize = sizeof(Vertex);
+	header.sourceTime = info.st_mtime;
+	header.sourceSize = info.st_size;
+	header.sourceHash = 0;
+	
+	return true;
+}
+
+std::vector<std::string> MeshCache::findMaterialFiles(const std::string& modelFile, const MappedFile& source) {
+	std::vector<std::string> materialFiles;
+	
+	//Libraries are named relative to the model
+	size_t slash = modelFile.find_last_of('/');
+	std::string directory = slash == std::string::npos ? "" : modelFile.substr(0, slash + 1);
+	
+	const char* text = reinterpret_cast<const char*>(source.data());
+	size_t size = source.size();
+	size_t lineStart = 0;
+	while(lineStart < size) {
+		size_t lineEnd = lineStart;
+		while(lineEnd < size && text[lineEnd] != '\n') lineEnd++;
+		
+		size_t start = lineStart;
+		while(start < lineEnd && (text[start] == ' ' || text[start] == '\t')) start++;
+		lineStart = lineEnd + 1;
+		
+		if(lineEnd - start < 7 || strncmp(text + start, "mtllib", 6) != 0 || (text[start + 6] != ' ' && text[start + 6] != '\t')) {
+			continue;
+		}
+		
+		//Like Assimp, the rest of the line is one name, so it can have spaces in it
+		start += 7;
+		size_t end = lineEnd;
+		while(start < end && (text[start] == ' ' || text[start] == '\t')) start++;
+		while(end > start && (text[end - 1] == ' ' || text[end - 1] == '\t' || text[end - 1] == '\r')) end--;
+		if(end > start) {
+			materialFiles.push_back(directory + std::string(text + start, end - start));
+		}
+	}
+	
+	return materialFiles;
+}
+
+void MeshCache::describeMaterialFile(const std::string& materialFile, bool withHash, MaterialFile& description) {
+	description.time = MESH_CACHE_MISSING_FILE;
+	description.size = 0;
+	description.hash = 0;
+	description.nameLength = materialFile.size();
+	
+	struct stat info;
+	if(stat(materialFile.c_str(), &info) != 0) {
+		return;
+	}
+	
+	description.time = info.st_mtime;
+	description.size = info.st_size;
+	
+	MappedFile source;
+	if(withHash && source.open(materialFile)) {
+		description.hash = source.hash();
+	}
+}
+
+bool MeshCache::read(const std::string& modelFile, std::vector<Mesh>& meshes, Bounds& bounds) {
+	Header expected;
+	if(!describeSource(modelFile, expected)) {
+		return false;
+	}
+	
+	MappedFile cache;
+	if(!cache.open(modelFile + MESH_CACHE_EXTENSION) || cache.size() < sizeof(Header)) {
+		return false;
+	}
+	
+	Header header;
+	memcpy(&header, cache.data(), sizeof(Header));
+	
+	if(header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION || header.vertexSize != sizeof(Vertex)) {
+		return false;
+	}
+	
+	//Only hash the model when the cheap check fails
+	if(header.sourceTime != expected.sourceTime || header.sourceSize != expected.sourceSize) {
+		MappedFile source;
+		if(!source.open(modelFile) || source.size() != header.sourceSize || source.hash() != header.sourceHash) {
+			return false;
+		}
+	}
+	
+	//Materials are saved with the meshes, so they're just as out of date if a library changed
+	size_t offset = sizeof(Header);
+	for(uint64_t i = 0; i < header.materialFileCount; i++) {
+		if(offset + sizeof(MaterialFile) > cache.size()) {
+			return false;
+		}
+		
+		MaterialFile stored;
+		memcpy(&stored, cache.data() + offset, sizeof(MaterialFile));
+		offset += sizeof(MaterialFile);
+		
+		if(stored.nameLength > cache.size() || offset + ((stored.nameLength + 7) & ~uint64_t(7)) > cache.size()) {
+			return false;
+		}
+		std::string materialFile(reinterpret_cast<const char*>(cache.data() + offset), stored.nameLength);
+		offset += (stored.nameLength + 7) & ~uint64_t(7);
+		
+		//Only hash the library when the cheap check fails, and it's still there to hash
+		MaterialFile current;
+		describeMaterialFile(materialFile, false, current);
+		if(current.time != stored.time || current.size != stored.size) {
+			if(current.time == MESH_CACHE_MISSING_FILE || stored.time == MESH_CACHE_MISSING_FILE || current.size != stored.size) {
+				return false;
+			}
+			
+			describeMaterialFile(materialFile, true, current);
+			if(current.hash != stored.hash) {
+				return false;
+			}
+		}
+	}
+	
+	std::vector<Mesh> newMeshes(header.meshCount);
+	
+	for(auto& i : newMeshes) {
+		if(offset + sizeof(MeshHeader) > cache.size()) {
+			return false;
+		}
+		
+		MeshHeader meshHeader;
+		memcpy(&meshHeader, cache.data() + offset, sizeof(MeshHeader));
+		offset += sizeof(MeshHeader);
+		
+		size_t vertexBytes = sizeof(Vertex) * meshHeader.vertexCount;
+		size_t indexBytes = sizeof(unsigned int) * meshHeader.indexCount;
+		size_t lodBytes = sizeof(MeshLOD) * meshHeader.lodCount;
+		size_t lodIndexBytes = sizeof(unsigned int) * meshHeader.lodIndexCount;
+		if(offset + vertexBytes + indexBytes + lodBytes + lodIndexBytes > cache.size()) {
+			return false;
+		}
+		
+		//Straight copies out of the mapping - nothing to parse
+		//Everything in the file is 4-byte aligned, and the mapping starts on a page
+		const Vertex* vertices = reinterpret_cast<const Vertex*>(cache.data() + offset);
+		i._vertices.assign(vertices, vertices + meshHeader.vertexCount);
+		offset += vertexBytes;
+		
+		const unsigned int* indices = reinterpret_cast<const unsigned int*>(cache.data() + offset);
+		i._indices.assign(indices, indices + meshHeader.indexCount);
+		offset += indexBytes;
+		
+		const MeshLOD* lods = reinterpret_cast<const MeshLOD*>(cache.data() + offset);
+		i.lods.assign(lods, lods + meshHeader.lodCount);
+		offset += lodBytes;
+		
+		const unsigned int* lodIndices = reinterpret_cast<const unsigned int*>(cache.data() + offset);
+		i._lodIndices.assign(lodIndices, lodIndices + meshHeader.lodIndexCount);
+		offset += lodIndexBytes;
+		
+		i.material.ambient = glm::make_vec3(&meshHeader.material[0]);
+		i.material.diffuse = glm::make_vec3(&meshHeader.material[3]);
+		i.material.specular = glm::make_vec3(&meshHeader.material[6]);
+		i.material.shininess = meshHeader.material[9];
+	}
+	
+	meshes.swap(newMeshes);
+	bounds.min = glm::make_vec3(&header.bounds[0]);
+	bounds.max = glm::make_vec3(&header.bounds[3]);
+	bounds.center = glm::make_vec3(&header.bounds[6]);
+	bounds.radius = header.bounds[9];
+	
+	return true;
+}
+
+bool MeshCache::write(const std::string& modelFile, const std::vector<Mesh>& meshes, const Bounds& bounds) {
+	Header header;
+	if(!describeSource(modelFile, header)) {
+		return false;
+	}
+	
+	MappedFile source;
+	if(!source.open(modelFile)) {
+		return false;
+	}
+	header.sourceHash = source.hash();
+	header.meshCount = meshes.size();
+	
+	std::vector<std::string> materialFiles = findMaterialFiles(modelFile, source);
+	header.materialFileCount = materialFiles.size();
+	
+	memcpy(&header.bounds[0], &bounds.min.x, sizeof(glm::vec3));
+	memcpy(&header.bounds[3], &bounds.max.x, sizeof(glm::vec3));
+	memcpy(&header.bounds[6], &bounds.center.x, sizeof(glm::vec3));
+	header.bounds[9] = bounds.radius;
+	
+	//Write somewhere else first, so a half-written cache is never read
+	std::string cacheFile = modelFile + MESH_CACHE_EXTENSION;
+	std::string tempFile = cacheFile + ".tmp";
+	
+	std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+	if(!out.is_open()) {
+		return false;
+	}
+	
+	out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	
+	//Names are padded so the mesh data after them stays aligned
+	const char padding[8] = {};
+	for(const auto& i : materialFiles) {
+		MaterialFile description;
+		describeMaterialFile(i, true, description);
+		out.write(reinterpret_cast<const char*>(&description), sizeof(MaterialFile));
+		out.write(i.data(), i.size());
+		out.write(padding, ((i.size() + 7) & ~size_t(7)) - i.size());
+	}
+	
+	for(const auto& i : meshes) {
+		MeshHeader meshHeader;
+		meshHeader.vertexCount = i._vertices.size();
+		meshHeader.indexCount = i._indices.size();
+		meshHeader.lodCount = i.lods.size();
+		meshHeader.lodIndexCount = i._lodIndices.size();
+		memcpy(&meshHeader.material[0], &i.material.ambient.x, sizeof(glm::vec3));
+		memcpy(&meshHeader.material[3], &i.material.diffuse.x, sizeof(glm::vec3));
+		memcpy(&meshHeader.material[6], &i.material.specular.x, sizeof(glm::vec3));
+		meshHeader.material[9] = i.material.shininess;
+		
+		out.write(reinterpret_cast<const char*>(&meshHeader), sizeof(MeshHeader));
+		out.write(reinterpret_cast<const char*>(i._vertices.data()), sizeof(Vertex) * i._vertices.size());
+		out.write(reinterpret_cast<const char*>(i._indices.data()), sizeof(unsigned int) * i._indices.size());
+		out.write(reinterpret_cast<const char*>(i.lods.data()), sizeof(MeshLOD) * i.lods.size());
+		out.write(reinterpret_cast<const char*>(i._lodIndices.data()), sizeof(unsigned int) * i._lodIndices.size());
+	}
+	
+	out.close();
+	if(!out) {
+		std::remove(tempFile.c_str());
+		return false;
+	}
+	
+	return std::rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+}
@@ -0,0 +1,271 @@
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <cmath>
+
+void MeshOptimizer::optimize(const std::string& name, Mesh& mesh, bool overdraw) {
+	if(mesh._indices.empty()) {
+		return;
+	}
+	
+	float before = acmr(mesh._indices, mesh._vertices.size());
+	
+	optimizeVertexCache(mesh._indices, mesh._vertices.size());
+	if(overdraw) {
+		optimizeOverdraw(mesh._indices, mesh._vertices, MESH_OPTIMIZER_OVERDRAW_THRESHOLD);
+	}
+	//Has to be last - it renumbers the vertices the steps above refer to
+	optimizeVertexFetch(mesh._vertices, mesh._indices);
+	
+	float after = acmr(mesh._indices, mesh._vertices.size());
+	std::cout << "Optimised " << name << ": ACMR " << before << " -> " << after << std::endl;
+}
+
+float MeshOptimizer::acmr(const std::vector<unsigned int>& indices, unsigned vertexCount) {
+	if(indices.size() < 3) {
+		return 0.0f;
+	}
+	
+	//Timestamps stand in for a FIFO - a vertex is cached if it was added in the last MESH_OPTIMIZER_FIFO_SIZE misses
+	std::vector<unsigned> addedAt(vertexCount, 0);
+	unsigned misses = 0;
+	
+	for(const auto& i : indices) {
+		if(addedAt[i] == 0 || misses + 1 - addedAt[i] > MESH_OPTIMIZER_FIFO_SIZE) {
+			misses++;
+			addedAt[i] = misses;
+		}
+	}
+	
+	return float(misses) / (indices.size() / 3);
+}
+
+float MeshOptimizer::vertexScore(int cachePosition, unsigned remainingTriangles) {
+	//Nothing left to draw with this vertex
+	if(remainingTriangles == 0) {
+		return -1.0f;
+	}
+	
+	float score = 0.0f;
+	if(cachePosition >= 0) {
+		if(cachePosition < 3) {
+			//Used by the last triangle - a small penalty so strips don't double back on themselves
+			score = 0.75f;
+		} else {
+			score = std::pow(1.0f - float(cachePosition - 3) / (MESH_OPTIMIZER_CACHE_SIZE - 3), 1.5f);
+		}
+	}
+	
+	//Finish off vertices with few triangles left, so they don't linger
+	score += 2.0f / std::sqrt(float(remainingTriangles));
+	
+	return score;
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<unsigned int>& indices, unsigned vertexCount) {
+	unsigned triangleCount = indices.size() / 3;
+	
+	//Triangles using each vertex, packed into one array
+	//Used triangles are swapped past the end of each vertex's remaining count
+	std::vector<unsigned> remaining(vertexCount, 0);
+	for(const auto& i : indices) {
+		remaining[i]++;
+	}
+	std::vector<unsigned> adjacencyStart(vertexCount + 1, 0);
+	for(unsigned i = 0; i < vertexCount; i++) {
+		adjacencyStart[i + 1] = adjacencyStart[i] + remaining[i];
+	}
+	std::vector<unsigned> adjacency(indices.size());
+	std::vector<unsigned> filled(vertexCount, 0);
+	for(unsigned i = 0; i < indices.size(); i++) {
+		unsigned vertex = indices[i];
+		adjacency[adjacencyStart[vertex] + filled[vertex]++] = i / 3;
+	}
+	
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> score(vertexCount);
+	for(unsigned i = 0; i < vertexCount; i++) {
+		score[i] = vertexScore(-1, remaining[i]);
+	}
+	
+	std::vector<float> triangleScore(triangleCount);
+	for(unsigned i = 0; i < triangleCount; i++) {
+		triangleScore[i] = score[indices[i * 3]] + score[indices[i * 3 + 1]] + score[indices[i * 3 + 2]];
+	}
+	std::vector<bool> emitted(triangleCount, false);
+	
+	std::vector<unsigned> cache;
+	std::vector<unsigned> newCache;
+	cache.reserve(MESH_OPTIMIZER_CACHE_SIZE + 3);
+	newCache.reserve(MESH_OPTIMIZER_CACHE_SIZE + 3);
+	
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	
+	unsigned scanPosition = 0;
+	int best = -1;
+	
+	for(unsigned emittedCount = 0; emittedCount < triangleCount; emittedCount++) {
+		//Nothing in the cache to carry on from, so just take the next triangle left
+		if(best < 0) {
+			while(emitted[scanPosition]) {
+				scanPosition++;
+			}
+			best = scanPosition;
+		}
+		
+		emitted[best] = true;
+		const unsigned* triangle = &indices[best * 3];
+		
+		//The triangle's vertices go to the front of the cache, and everything else moves back
+		newCache.clear();
+		for(unsigned i = 0; i < 3; i++) {
+			unsigned vertex = triangle[i];
+			result.push_back(vertex);
+			newCache.push_back(vertex);
+			
+			//This triangle no longer needs drawing
+			unsigned* begin = &adjacency[adjacencyStart[vertex]];
+			unsigned* end = begin + remaining[vertex];
+			std::iter_swap(std::find(begin, end, unsigned(best)), end - 1);
+			remaining[vertex]--;
+		}
+		for(const auto& i : cache) {
+			if(i != triangle[0] && i != triangle[1] && i != triangle[2]) {
+				newCache.push_back(i);
+			}
+		}
+		
+		//Rescore everything that was or is in the cache
+		for(unsigned i = 0; i < newCache.size(); i++) {
+			unsigned vertex = newCache[i];
+			cachePosition[vertex] = i < MESH_OPTIMIZER_CACHE_SIZE ? int(i) : -1;
+			score[vertex] = vertexScore(cachePosition[vertex], remaining[vertex]);
+		}
+		if(newCache.size() > MESH_OPTIMIZER_CACHE_SIZE) {
+			newCache.resize(MESH_OPTIMIZER_CACHE_SIZE);
+		}
+		cache.swap(newCache);
+		
+		//Then pick the best triangle that uses a cached vertex
+		best = -1;
+		float bestScore = -1.0f;
+		for(const auto& vertex : cache) {
+			for(unsigned i = 0; i < remaining[vertex]; i++) {
+				unsigned candidate = adjacency[adjacencyStart[vertex] + i];
+				const unsigned* candidateVertices = &indices[candidate * 3];
+				triangleScore[candidate] = score[candidateVertices[0]] + score[candidateVertices[1]] + score[candidateVertices[2]];
+				
+				if(triangleScore[candidate] > bestScore) {
+					bestScore = triangleScore[candidate];
+					best = candidate;
+				}
+			}
+		}
+	}
+	
+	indices.swap(result);
+}
+
+bool MeshOptimizer::compareClusters(const Cluster& a, const Cluster& b) {
+	return a.sortKey > b.sortKey;
+}
+
+void MeshOptimizer::optimizeOverdraw(std::vector<unsigned int>& indices, const std::vector<Vertex>& vertices, float threshold) {
+	if(indices.empty() || vertices.empty()) {
+		return;
+	}
+	
+	//Split where a triangle misses on all its vertices - the cache is being refilled there anyway
+	std::vector<Cluster> clusters;
+	std::vector<unsigned> addedAt(vertices.size(), 0);
+	unsigned misses = 0;
+	
+	for(unsigned i = 0; i < indices.size(); i += 3) {
+		unsigned triangleMisses = 0;
+		for(unsigned j = 0; j < 3; j++) {
+			unsigned vertex = indices[i + j];
+			if(addedAt[vertex] == 0 || misses + 1 - addedAt[vertex] > MESH_OPTIMIZER_FIFO_SIZE) {
+				misses++;
+				addedAt[vertex] = misses;
+				triangleMisses++;
+			}
+		}
+		
+		if(clusters.empty() || triangleMisses == 3) {
+			Cluster cluster = {i, i, 0.0f};
+			clusters.push_back(cluster);
+		}
+		clusters.back().end = i + 3;
+	}
+	
+	if(clusters.size() < 2) {
+		return;
+	}
+	
+	glm::vec3 meshCenter(0.0f);
+	for(const auto& i : vertices) {
+		meshCenter += i.vertex;
+	}
+	meshCenter /= float(vertices.size());
+	
+	//Clusters facing away from the middle of the mesh are most likely to be in front, so draw them first
+	for(auto& cluster : clusters) {
+		glm::vec3 center(0.0f);
+		glm::vec3 normal(0.0f);
+		float area = 0.0f;
+		
+		for(unsigned i = cluster.start; i < cluster.end; i += 3) {
+			const glm::vec3& a = vertices[indices[i]].vertex;
+			const glm::vec3& b = vertices[indices[i + 1]].vertex;
+			const glm::vec3& c = vertices[indices[i + 2]].vertex;
+			
+			//Weighted by area, which is the length of the cross product
+			glm::vec3 cross = glm::cross(b - a, c - a);
+			float triangleArea = glm::length(cross);
+			center += (a + b + c) / 3.0f * triangleArea;
+			normal += cross;
+			area += triangleArea;
+		}
+		
+		if(area > 0.0f) {
+			center /= area;
+		}
+		float normalLength = glm::length(normal);
+		if(normalLength > 0.0f) {
+			normal /= normalLength;
+		}
+		
+		cluster.sortKey = glm::dot(center - meshCenter, normal);
+	}
+	
+	std::stable_sort(clusters.begin(), clusters.end(), compareClusters);
+	
+	std::vector<unsigned int> result;
+	result.reserve(indices.size());
+	for(const auto& cluster : clusters) {
+		result.insert(result.end(), indices.begin() + cluster.start, indices.begin() + cluster.end);
+	}
+	
+	//Don't give up too much of the vertex cache for it
+	if(acmr(result, vertices.size()) <= acmr(indices, vertices.size()) * threshold) {
+		indices.swap(result);
+	}
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<unsigned int>& indices) {
+	const unsigned unused = ~0u;
+	std::vector<unsigned> remap(vertices.size(), unused);
+	std::vector<Vertex> result;
+	result.reserve(vertices.size());
+	
+	for(auto& i : indices) {
+		if(remap[i] == unused) {
+			remap[i] = result.size();
+			result.push_back(vertices[i]);
+		}
+		i = remap[i];
+	}
+	
+	vertices.swap(result);
+}
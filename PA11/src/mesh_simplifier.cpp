@@ -0,0 +1,259 @@
+#include "mesh_simplifier.h"
+#include "mesh_optimizer.h"
+
+#include <algorithm>
+#include <map>
+#include <tuple>
+
+void MeshSimplifier::generateLODs(Mesh& mesh, unsigned levels) {
+	mesh.lods.clear();
+	mesh._lodIndices.clear();
+	
+	MeshLOD full = {0, unsigned(mesh._indices.size())};
+	mesh.lods.push_back(full);
+	
+	//Errors are measured against the size of the mesh, so they mean the same thing at any scale
+	glm::vec3 low = mesh._vertices.empty() ? glm::vec3(0.0f) : mesh._vertices[0].vertex;
+	glm::vec3 high = low;
+	for(const auto& i : mesh._vertices) {
+		low = glm::min(low, i.vertex);
+		high = glm::max(high, i.vertex);
+	}
+	float size = glm::length(high - low) * MESH_SIMPLIFIER_MAX_ERROR;
+	
+	std::vector<unsigned int> indices = mesh._indices;
+	for(unsigned level = 0; level < levels; level++) {
+		unsigned lastCount = indices.size();
+		unsigned target = unsigned(lastCount / 3 * MESH_SIMPLIFIER_LOD_RATIO) * 3;
+		
+		simplify(mesh._vertices, indices, target, size * size);
+		
+		//Not worth another level if it barely got any smaller
+		if(indices.size() < 3 || indices.size() > lastCount * MESH_SIMPLIFIER_MIN_REDUCTION) {
+			break;
+		}
+		
+		std::vector<unsigned int> ordered = indices;
+		MeshOptimizer::optimizeVertexCache(ordered, mesh._vertices.size());
+		
+		//Levels are stored after the full mesh's indices
+		MeshLOD lod = {unsigned(mesh._indices.size() + mesh._lodIndices.size()), unsigned(ordered.size())};
+		mesh.lods.push_back(lod);
+		mesh._lodIndices.insert(mesh._lodIndices.end(), ordered.begin(), ordered.end());
+	}
+}
+
+void MeshSimplifier::addPlane(Quadric& quadric, const glm::vec3& normal, float distance, float weight) {
+	quadric.a00 += weight * normal.x * normal.x;
+	quadric.a01 += weight * normal.x * normal.y;
+	quadric.a02 += weight * normal.x * normal.z;
+	quadric.a11 += weight * normal.y * normal.y;
+	quadric.a12 += weight * normal.y * normal.z;
+	quadric.a22 += weight * normal.z * normal.z;
+	quadric.b0 += weight * normal.x * distance;
+	quadric.b1 += weight * normal.y * distance;
+	quadric.b2 += weight * normal.z * distance;
+	quadric.c += weight * distance * distance;
+}
+
+void MeshSimplifier::addQuadric(Quadric& quadric, const Quadric& other) {
+	quadric.a00 += other.a00;
+	quadric.a01 += other.a01;
+	quadric.a02 += other.a02;
+	quadric.a11 += other.a11;
+	quadric.a12 += other.a12;
+	quadric.a22 += other.a22;
+	quadric.b0 += other.b0;
+	quadric.b1 += other.b1;
+	quadric.b2 += other.b2;
+	quadric.c += other.c;
+}
+
+float MeshSimplifier::quadricError(const Quadric& q, const glm::vec3& p) {
+	float error = q.a00 * p.x * p.x + q.a11 * p.y * p.y + q.a22 * p.z * p.z +
+	              2.0f * (q.a01 * p.x * p.y + q.a02 * p.x * p.z + q.a12 * p.y * p.z) +
+	              2.0f * (q.b0 * p.x + q.b1 * p.y + q.b2 * p.z) + q.c;
+	
+	//Rounding can take it a little under 0
+	return std::max(error, 0.0f);
+}
+
+bool MeshSimplifier::flipsTriangle(const std::vector<Vertex>& vertices, const std::vector<unsigned int>& indices, const std::vector<unsigned>& triangles, unsigned from, unsigned to) {
+	for(const auto& triangle : triangles) {
+		const unsigned int* corners = &indices[triangle * 3];
+		
+		//Triangles along the edge disappear, so they can't flip
+		if(corners[0] == to || corners[1] == to || corners[2] == to) {
+			continue;
+		}
+		
+		glm::vec3 positions[3];
+		glm::vec3 moved[3];
+		for(unsigned i = 0; i < 3; i++) {
+			positions[i] = vertices[corners[i]].vertex;
+			moved[i] = corners[i] == from ? vertices[to].vertex : positions[i];
+		}
+		
+		glm::vec3 before = glm::cross(positions[1] - positions[0], positions[2] - positions[0]);
+		glm::vec3 after = glm::cross(moved[1] - moved[0], moved[2] - moved[0]);
+		
+		//Also reject anything that turns too far - the normals would be stretched over it
+		if(glm::dot(before, after) <= 0.25f * glm::length(before) * glm::length(after)) {
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+bool MeshSimplifier::compareCollapses(const Collapse& a, const Collapse& b) {
+	return a.error < b.error;
+}
+
+void MeshSimplifier::simplify(const std::vector<Vertex>& vertices, std::vector<unsigned int>& indices, unsigned targetIndexCount, float maxError) {
+	unsigned vertexCount = vertices.size();
+	
+	//Vertices sharing a position but not the rest of their attributes sit on a UV or normal seam
+	//Those, and anything on an open edge, are locked in place
+	std::vector<bool> locked(vertexCount, false);
+	std::map<std::tuple<float, float, float>, unsigned> positions;
+	std::vector<unsigned> welded(vertexCount);
+	for(unsigned i = 0; i < vertexCount; i++) {
+		std::tuple<float, float, float> key(vertices[i].vertex.x, vertices[i].vertex.y, vertices[i].vertex.z);
+		auto found = positions.find(key);
+		if(found == positions.end()) {
+			positions[key] = i;
+			welded[i] = i;
+		} else {
+			welded[i] = found->second;
+			locked[i] = true;
+			locked[found->second] = true;
+		}
+	}
+	
+	//Edges used by only one triangle are open - counted with the welded vertices, so seams aren't mistaken for holes
+	std::map<std::pair<unsigned, unsigned>, unsigned> edgeUses;
+	for(unsigned i = 0; i < indices.size(); i += 3) {
+		for(unsigned j = 0; j < 3; j++) {
+			unsigned a = welded[indices[i + j]];
+			unsigned b = welded[indices[i + (j + 1) % 3]];
+			edgeUses[std::make_pair(std::min(a, b), std::max(a, b))]++;
+		}
+	}
+	for(unsigned i = 0; i < indices.size(); i += 3) {
+		for(unsigned j = 0; j < 3; j++) {
+			unsigned a = indices[i + j];
+			unsigned b = indices[i + (j + 1) % 3];
+			if(edgeUses[std::make_pair(std::min(welded[a], welded[b]), std::max(welded[a], welded[b]))] == 1) {
+				locked[a] = true;
+				locked[b] = true;
+			}
+		}
+	}
+	
+	//Each vertex starts with the planes of the triangles around it, weighted by area
+	Quadric empty = {0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f};
+	std::vector<Quadric> quadrics(vertexCount, empty);
+	for(unsigned i = 0; i < indices.size(); i += 3) {
+		const glm::vec3& a = vertices[indices[i]].vertex;
+		glm::vec3 normal = glm::cross(vertices[indices[i + 1]].vertex - a, vertices[indices[i + 2]].vertex - a);
+		float area = glm::length(normal);
+		if(area <= 0.0f) {
+			continue;
+		}
+		normal /= area;
+		
+		for(unsigned j = 0; j < 3; j++) {
+			addPlane(quadrics[indices[i + j]], normal, -glm::dot(normal, a), area);
+		}
+	}
+	
+	std::vector<std::vector<unsigned>> triangles(vertexCount);
+	std::vector<Collapse> collapses;
+	std::vector<bool> touched(vertexCount);
+	std::vector<unsigned> remap(vertexCount);
+	
+	for(unsigned pass = 0; pass < MESH_SIMPLIFIER_MAX_PASSES && indices.size() > targetIndexCount; pass++) {
+		for(auto& i : triangles) {
+			i.clear();
+		}
+		for(unsigned i = 0; i < indices.size(); i++) {
+			triangles[indices[i]].push_back(i / 3);
+		}
+		
+		//Every edge can collapse either way
+		collapses.clear();
+		for(unsigned i = 0; i < indices.size(); i += 3) {
+			for(unsigned j = 0; j < 3; j++) {
+				unsigned a = indices[i + j];
+				unsigned b = indices[i + (j + 1) % 3];
+				
+				Quadric combined = quadrics[a];
+				addQuadric(combined, quadrics[b]);
+				
+				if(!locked[a]) {
+					Collapse collapse = {a, b, quadricError(combined, vertices[b].vertex)};
+					collapses.push_back(collapse);
+				}
+				if(!locked[b]) {
+					Collapse collapse = {b, a, quadricError(combined, vertices[a].vertex)};
+					collapses.push_back(collapse);
+				}
+			}
+		}
+		std::sort(collapses.begin(), collapses.end(), compareCollapses);
+		
+		//Take the cheapest collapses that don't touch each other's triangles
+		std::fill(touched.begin(), touched.end(), false);
+		for(unsigned i = 0; i < vertexCount; i++) {
+			remap[i] = i;
+		}
+		
+		unsigned remaining = indices.size();
+		unsigned collapsed = 0;
+		for(const auto& collapse : collapses) {
+			if(collapse.error > maxError || remaining <= targetIndexCount) {
+				break;
+			}
+			if(touched[collapse.from] || touched[collapse.to]) {
+				continue;
+			}
+			if(flipsTriangle(vertices, indices, triangles[collapse.from], collapse.from, collapse.to)) {
+				continue;
+			}
+			
+			remap[collapse.from] = collapse.to;
+			addQuadric(quadrics[collapse.to], quadrics[collapse.from]);
+			collapsed++;
+			
+			for(const auto& triangle : triangles[collapse.from]) {
+				const unsigned int* corners = &indices[triangle * 3];
+				if(corners[0] == collapse.to || corners[1] == collapse.to || corners[2] == collapse.to) {
+					remaining -= 3;
+				}
+				for(unsigned j = 0; j < 3; j++) {
+					touched[corners[j]] = true;
+				}
+			}
+		}
+		
+		if(collapsed == 0) {
+			break;
+		}
+		
+		//Move collapsed vertices and drop the triangles that disappeared
+		unsigned kept = 0;
+		for(unsigned i = 0; i < indices.size(); i += 3) {
+			unsigned a = remap[indices[i]];
+			unsigned b = remap[indices[i + 1]];
+			unsigned c = remap[indices[i + 2]];
+			
+			if(a != b && b != c && a != c) {
+				indices[kept++] = a;
+				indices[kept++] = b;
+				indices[kept++] = c;
+			}
+		}
+		indices.resize(kept);
+	}
+}
@@ -5,98 +5,315 @@
 #define MODEL
 
 #include "model.h"
+#include "mesh_cache.h"
+#include "block_compress.h"
+#include "mesh_optimizer.h"
+#include "mesh_simplifier.h"
+#include "gl_state.h"
+
+#include <algorithm>
+#include <future>
+#include <glm/gtc/packing.hpp>
 
 Model* Model::load(std::string filename) {
-	static std::unordered_map<std::string, Model*> loadedModels;
+	//Models can be loaded from several threads at once - see AssetLoader
+	//The first to ask for a file claims it, and anyone else asking meanwhile waits for that import rather than starting their own
+	static std::unordered_map<std::string, std::shared_future<Model*>> loadedModels;
+	static std::mutex loadedModelsMutex;
 	
-	//If we already loaded this model before, don't do it again
-	if(loadedModels.find(filename) != loadedModels.end()) {
-		return loadedModels[filename];
+	std::promise<Model*> claim;
+	std::shared_future<Model*> loaded;
+	{
+		std::lock_guard<std::mutex> lock(loadedModelsMutex);
+		auto found = loadedModels.find(filename);
+		if(found != loadedModels.end()) {
+			loaded = found->second;
+		} else {
+			loadedModels[filename] = claim.get_future().share();
+		}
 	}
-
-	Model* newModel = new Model();
 	
-	Assimp::Importer import;
-	const aiScene* scene = import.ReadFile(filename, aiProcessPreset_TargetRealtime_Fast);
-	if(scene == nullptr) {
-		std::cerr << "Could not load model from " << filename << std::endl;
-		return nullptr;
+	//Waited on outside the lock, so loads of other files carry on meanwhile
+	if(loaded.valid()) {
+		return loaded.get();
 	}
 	
+	Model* newModel = import(filename);
+	claim.set_value(newModel);
 	
-	for(int i = 0; i < scene->mNumMeshes; i++) {
-		aiMesh* mesh = scene->mMeshes[i];
-		Mesh newMesh;
+	return newModel;
+}
+
+Model* Model::import(const std::string& filename) {
+	Model* newModel = new Model();
+	
+	//Skip Assimp entirely if we've imported this model before
+	if(!MeshCache::read(filename, newModel->meshes, newModel->bounds)) {
+		Assimp::Importer import;
+		const aiScene* scene = import.ReadFile(filename, aiProcessPreset_TargetRealtime_Fast);
+		if(scene == nullptr) {
+			std::cerr << "Could not load model from " << filename << std::endl;
+			delete newModel;
+			return nullptr;
+		}
+		
 		
-		loadVertices(mesh, &newMesh);
-		loadIndices(mesh, &newMesh);
-		newMesh.material = loadMaterials(scene, i);
+		for(int i = 0; i < scene->mNumMeshes; i++) {
+			aiMesh* mesh = scene->mMeshes[i];
+			Mesh newMesh;
+			
+			loadVertices(mesh, &newMesh);
+			loadIndices(mesh, &newMesh);
+			newMesh.material = loadMaterials(scene, i);
+			
+			newModel->meshes.push_back(newMesh);
+		}
 		
-		newModel->meshes.push_back(newMesh);
+		//Only done on import, so it's worth taking the time
+		for(auto& i : newModel->meshes) {
+#ifdef OPTIMIZE_OVERDRAW
+			MeshOptimizer::optimize(filename, i, true);
+#else
+			MeshOptimizer::optimize(filename, i, false);
+#endif
+			//Lower detail levels are made from the optimised mesh, and reordered themselves
+			MeshSimplifier::generateLODs(i, MODEL_LOD_LEVELS);
+		}
+		
+		newModel->bounds = computeBounds(newModel->meshes);
+		
+		MeshCache::write(filename, newModel->meshes, newModel->bounds);
 	}
 	
 	newModel->initialised = false;
 	
-	//Now save this model for later in case we need to use it again
-	loadedModels[filename] = newModel;
-	
 	return newModel;
 }
 
-Model::Model(){}
+std::atomic<unsigned> Model::sortIDCounter(0);
+
+Model::Model() : materialUniforms(nullptr), sortID(sortIDCounter++) {}
+
+unsigned Model::getSortID() const {
+	return sortID;
+}
 
 void Model::initGL() {
 	if(!initialised) {
 		for(auto& i : meshes) {
+			//Positions are kept apart so depth-only passes don't fetch anything else
+			std::vector<glm::vec3> positions(i._vertices.size());
+			std::vector<PackedVertex> packed(i._vertices.size());
+			for(unsigned j = 0; j < i._vertices.size(); j++) {
+				positions[j] = i._vertices[j].vertex;
+				packed[j] = packVertex(i._vertices[j]);
+			}
+			
+			glGenBuffers(1, &i.positionVB);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, i.positionVB);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(glm::vec3) * positions.size(), &positions[0], GL_STATIC_DRAW);
+			
 			glGenBuffers(1, &i.VB);
-			glBindBuffer(GL_ARRAY_BUFFER, i.VB);
-			glBufferData(GL_ARRAY_BUFFER, sizeof(Vertex) * i._vertices.size(), &i._vertices[0], GL_STATIC_DRAW);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, i.VB);
+			glBufferData(GL_ARRAY_BUFFER, sizeof(PackedVertex) * packed.size(), &packed[0], GL_STATIC_DRAW);
 			
+			//Every level of detail shares one index buffer
+			if(i.lods.empty()) {
+				MeshLOD full = {0, unsigned(i._indices.size())};
+				i.lods.push_back(full);
+			}
+			std::vector<unsigned int> indices(i._indices);
+			indices.insert(indices.end(), i._lodIndices.begin(), i._lodIndices.end());
+			
+			//Draws leave their VAO bound, and it would take this index buffer
+			GLState::bindVertexArray(0);
 			glGenBuffers(1, &i.IB);
-			glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, i.IB);
-			glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * i._indices.size(), &i._indices[0], GL_STATIC_DRAW);
+			GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, i.IB);
+			//Small meshes only need half the index data
+			if(i._vertices.size() <= 0xFFFF) {
+				std::vector<uint16_t> shortIndices(indices.begin(), indices.end());
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(uint16_t) * shortIndices.size(), &shortIndices[0], GL_STATIC_DRAW);
+				i.indexType = GL_UNSIGNED_SHORT;
+			} else {
+				glBufferData(GL_ELEMENT_ARRAY_BUFFER, sizeof(unsigned int) * indices.size(), &indices[0], GL_STATIC_DRAW);
+				i.indexType = GL_UNSIGNED_INT;
+			}
+			
+			//Everything bound from here on is recorded in the mesh's VAO
+			glGenVertexArrays(1, &i.VAO);
+			GLState::bindVertexArray(i.VAO);
+			bindMeshAttributes(i, false);
+			
+			glGenVertexArrays(1, &i.depthVAO);
+			GLState::bindVertexArray(i.depthVAO);
+			bindMeshAttributes(i, true);
+			
+			//Unbind the VAO first so it keeps its index buffer
+			GLState::bindVertexArray(0);
+			GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+			GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 		}
 		
+		//Materials never change, so they're sent once here and just bound when drawing
+		MaterialDataLayout layout;
+		materialUniforms = new UniformBuffer(UBO_MATERIAL_BINDING, layout.size, meshes.size());
+		materialUniforms->initGL();
+		for(unsigned i = 0; i < meshes.size(); i++) {
+			materialUniforms->write(i, layout.ambient, &meshes[i].material.ambient.r, sizeof(glm::vec3));
+			materialUniforms->write(i, layout.diffuse, &meshes[i].material.diffuse.r, sizeof(glm::vec3));
+			materialUniforms->write(i, layout.specular, &meshes[i].material.specular.r, sizeof(glm::vec3));
+			materialUniforms->write(i, layout.shininess, &meshes[i].material.shininess, sizeof(float));
+		}
+		materialUniforms->upload(meshes.size());
+		
 		initialised = true;
 	}
 }
 
-void Model::drawModel(Shader* shader) {
+void Model::bindMeshAttributes(Mesh& mesh, bool depthOnly) {
+	GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, mesh.IB);
+	
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mesh.positionVB);
 	glEnableVertexAttribArray(0);
+	glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(glm::vec3), nullptr);
+	
+	if(depthOnly) {
+		return;
+	}
+	
+	//Now describe uvs, normals, and tangents
+	//The bitangent is cross(normal, tangent) * tangent.w
+	GLState::bindBuffer(GL_ARRAY_BUFFER, mesh.VB);
 	glEnableVertexAttribArray(1);
 	glEnableVertexAttribArray(2);
 	glEnableVertexAttribArray(3);
-	glEnableVertexAttribArray(4);
+	
+	glVertexAttribPointer(1, 2, GL_HALF_FLOAT, GL_FALSE, sizeof(PackedVertex), (void *) offsetof(PackedVertex, uv));
+	glVertexAttribPointer(2, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void *) offsetof(PackedVertex, normal));
+	glVertexAttribPointer(3, 4, GL_INT_2_10_10_10_REV, GL_TRUE, sizeof(PackedVertex), (void *) offsetof(PackedVertex, tangent));
+}
+
+PackedVertex Model::packVertex(const Vertex& vertex) {
+	PackedVertex packed;
+	packed.uv[0] = glm::packHalf1x16(vertex.uv.x);
+	packed.uv[1] = glm::packHalf1x16(vertex.uv.y);
+	packed.normal = packSigned1010102(glm::vec4(vertex.normal, 0.0f));
+	
+	//Flipped UVs give a left-handed basis, which is all the bitangent is needed for
+	float handedness = glm::dot(glm::cross(vertex.normal, vertex.tangent), vertex.bitangent) < 0.0f ? -1.0f : 1.0f;
+	packed.tangent = packSigned1010102(glm::vec4(vertex.tangent, handedness));
+	
+	return packed;
+}
+
+uint32_t Model::packSigned1010102(const glm::vec4& vector) {
+	glm::vec4 clamped = glm::clamp(vector, -1.0f, 1.0f);
+	
+	uint32_t x = int32_t(glm::round(clamped.x * 511.0f)) & 0x3FF;
+	uint32_t y = int32_t(glm::round(clamped.y * 511.0f)) & 0x3FF;
+	uint32_t z = int32_t(glm::round(clamped.z * 511.0f)) & 0x3FF;
+	//Before OpenGL 4.2 a 2 bit -1 reads back as -1/3, but -2 reads as -1 under both the old rule and the new one
+	uint32_t w = (clamped.w < 0.0f ? -2 : int32_t(glm::round(clamped.w))) & 0x3;
+	
+	return x | (y << 10) | (z << 20) | (w << 30);
+}
+
+std::vector<GLuint> Model::initInstancedGL(GLuint instanceBuffer, bool depthOnly) {
+	std::vector<GLuint> vaos;
 	
 	for(auto& i : meshes) {
-		if(shader != nullptr) {
-			//Send the material information
-			shader->uniform3fv("MaterialAmbientColor", 1, &i.material.ambient.r);
-			shader->uniform3fv("MaterialDiffuseColor", 1, &i.material.diffuse.r);
-			shader->uniform3fv("MaterialSpecularColor", 1, &i.material.specular.r);
-			shader->uniform1fv("shininess", 1, &i.material.shininess);
+		GLuint vao;
+		glGenVertexArrays(1, &vao);
+		GLState::bindVertexArray(vao);
+		bindMeshAttributes(i, depthOnly);
+		
+		//Per-instance attributes advance once per instance instead of once per vertex
+		GLState::bindBuffer(GL_ARRAY_BUFFER, instanceBuffer);
+		//A mat4 takes up 4 attribute locations, one per column
+		for(int j = 0; j < 4; j++) {
+			glEnableVertexAttribArray(5 + j);
+			glVertexAttribPointer(5 + j, 4, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *) (offsetof(InstanceData, model) + sizeof(glm::vec4) * j));
+			glVertexAttribDivisor(5 + j, 1);
 		}
+		glEnableVertexAttribArray(9);
+		glVertexAttribPointer(9, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *) offsetof(InstanceData, layer));
+		glVertexAttribDivisor(9, 1);
+		glEnableVertexAttribArray(10);
+		glVertexAttribPointer(10, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *) offsetof(InstanceData, id));
+		glVertexAttribDivisor(10, 1);
+		glEnableVertexAttribArray(11);
+		glVertexAttribPointer(11, 1, GL_FLOAT, GL_FALSE, sizeof(InstanceData), (void *) offsetof(InstanceData, highlight));
+		glVertexAttribDivisor(11, 1);
 		
-		glBindBuffer(GL_ARRAY_BUFFER, i.VB);
-		//Now send vertices, uvs, and normals
-		glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), nullptr);
-		glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void *) offsetof(Vertex, uv));
-		glVertexAttribPointer(2, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void *) offsetof(Vertex, normal));
-		glVertexAttribPointer(3, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void *) offsetof(Vertex, tangent));
-		glVertexAttribPointer(4, 3, GL_FLOAT, GL_TRUE, sizeof(Vertex), (void *) offsetof(Vertex, bitangent));
+		GLState::bindVertexArray(0);
+		GLState::bindBuffer(GL_ARRAY_BUFFER, 0);
+		GLState::bindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
 		
-		//Send all our face information
-		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, i.IB);
+		vaos.push_back(vao);
+	}
+	
+	return vaos;
+}
+
+void Model::drawModel(Shader* shader, unsigned lod) {
+	for(unsigned i = 0; i < meshes.size(); i++) {
+		if(shader != nullptr) {
+			//Use this mesh's material information
+			materialUniforms->bind(i);
+		}
+		
+		//Vertex layout and face information were recorded in initGL()
+		GLState::bindVertexArray(meshes[i].VAO);
 		
 		//Now draw everything
-		glDrawElements(GL_TRIANGLES, i._indices.size(), GL_UNSIGNED_INT, 0);
+		const MeshLOD& level = meshes[i].lods[std::min(lod, unsigned(meshes[i].lods.size() - 1))];
+		GLState::drawElements(GL_TRIANGLES, level.count, meshes[i].indexType, indexOffset(meshes[i], level));
+	}
+}
+
+void Model::drawModelDepth(unsigned lod) {
+	for(auto& i : meshes) {
+		GLState::bindVertexArray(i.depthVAO);
+		
+		const MeshLOD& level = i.lods[std::min(lod, unsigned(i.lods.size() - 1))];
+		GLState::drawElements(GL_TRIANGLES, level.count, i.indexType, indexOffset(i, level));
+	}
+}
+
+const GLvoid* Model::indexOffset(const Mesh& mesh, const MeshLOD& lod) {
+	size_t indexSize = mesh.indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(unsigned int);
+	return (const GLvoid*) (lod.offset * indexSize);
+}
+
+float Model::lodBias = 1.0f;
+const float Model::lodScreenSizes[MODEL_LOD_LEVELS] = {0.25f, 0.1f, 0.04f};
+const float Model::shadowLODScreenSizes[MODEL_LOD_LEVELS] = {0.5f, 0.2f, 0.08f};
+
+unsigned Model::selectLOD(float screenSize, bool shadow) {
+	const float* sizes = shadow ? shadowLODScreenSizes : lodScreenSizes;
+	float biasedSize = screenSize * lodBias;
+	
+	unsigned lod = 0;
+	while(lod < MODEL_LOD_LEVELS && biasedSize < sizes[lod]) {
+		lod++;
 	}
 	
-	glDisableVertexAttribArray(0);
-	glDisableVertexAttribArray(1);
-	glDisableVertexAttribArray(2);
-	glDisableVertexAttribArray(3);
-	glDisableVertexAttribArray(4);
+	return lod;
+}
+
+void Model::drawModelInstanced(Shader* shader, const std::vector<GLuint>& vaos, GLsizei count, unsigned lod) {
+	for(unsigned i = 0; i < meshes.size(); i++) {
+		if(shader != nullptr) {
+			//Use this mesh's material information
+			materialUniforms->bind(i);
+		}
+		
+		GLState::bindVertexArray(vaos[i]);
+		
+		//Every instance in one call
+		const MeshLOD& level = meshes[i].lods[std::min(lod, unsigned(meshes[i].lods.size() - 1))];
+		GLState::drawElementsInstanced(GL_TRIANGLES, level.count, meshes[i].indexType, indexOffset(meshes[i], level), count);
+	}
 }
 
 void Model::loadVertices(aiMesh *mesh, Mesh *newModel)
@@ -171,58 +388,216 @@ Material Model::loadMaterials(const aiScene *scene, int meshIndex)
 	return modelMaterial;
 }
 
-Texture* Texture::load(std::string filename) {
-	static std::unordered_map<std::string, Texture*> loadedTextures;
+Bounds Model::computeBounds(const std::vector<Mesh>& meshes) {
+	Bounds bounds;
 	
-	//If we already have the texture loaded, don't load it again
-	if(loadedTextures.find(filename) != loadedTextures.end()) {
-		return loadedTextures[filename];
+	bool first = true;
+	for(const auto& i : meshes) {
+		for(const auto& j : i._vertices) {
+			if(first) {
+				bounds.min = j.vertex;
+				bounds.max = j.vertex;
+				first = false;
+			} else {
+				bounds.min = glm::min(bounds.min, j.vertex);
+				bounds.max = glm::max(bounds.max, j.vertex);
+			}
+		}
 	}
+	
+	//Centering the sphere on the box is close enough, and the radius just has to reach the farthest vertex
+	bounds.center = (bounds.min + bounds.max) * 0.5f;
+	for(const auto& i : meshes) {
+		for(const auto& j : i._vertices) {
+			bounds.radius = std::max(bounds.radius, glm::length(j.vertex - bounds.center));
+		}
+	}
+	
+	return bounds;
+}
+
+Texture* Texture::load(std::string filename, bool normalMap) {
+	//Textures can be loaded from several threads at once - see AssetLoader
+	//The first to ask for a file claims it, and anyone else asking meanwhile waits for that decode rather than starting their own
+	static std::unordered_map<std::string, std::shared_future<Texture*>> loadedTextures;
+	static std::mutex loadedTexturesMutex;
+	
+	std::promise<Texture*> claim;
+	std::shared_future<Texture*> loaded;
+	{
+		std::lock_guard<std::mutex> lock(loadedTexturesMutex);
+		auto found = loadedTextures.find(filename);
+		if(found != loadedTextures.end()) {
+			loaded = found->second;
+		} else {
+			loadedTextures[filename] = claim.get_future().share();
+		}
+	}
+	
+	//Waited on outside the lock, so loads of other files carry on meanwhile
+	if(loaded.valid()) {
+		return loaded.get();
+	}
+	
+	Texture* newTex = decode(filename, normalMap);
+	claim.set_value(newTex);
+	
+	return newTex;
+}
+
+Texture* Texture::decode(const std::string& filename, bool normalMap) {
 	Texture* newTex = new Texture();
 	
-	//Load our texture with ImageMagick
-	try {
-		newTex->m_Image = new Magick::Image(filename);
-		newTex->m_Blob = new Magick::Blob();
-		newTex->m_Image->write(newTex->m_Blob, "RGBA");
-	} catch(Magick::Error& err) {
-		std::cout << "Could not load texture \"" << filename <<"\": " << err.what() << std::endl;
-		return nullptr;
+	//Use the decoded mip chain from a previous run if we can
+	if(!TextureCache::read(filename, newTex->m_mapping, newTex->m_image)) {
+		//Otherwise load our texture with ImageMagick
+		try {
+			Magick::Image image(filename);
+			Magick::Blob blob;
+			image.write(&blob, "RGBA");
+			
+			const unsigned char* rgba = static_cast<const unsigned char*>(blob.data());
+			TextureCache::buildMipChain(rgba, image.columns(), image.rows(), newTex->m_pixels, newTex->m_image);
+			//Compressing is slow, but only has to happen once per texture
+			BlockCompress::compress(BlockCompress::chooseFormat(rgba, image.columns(), image.rows(), normalMap), newTex->m_image, newTex->m_pixels);
+		} catch(Magick::Error& err) {
+			std::cout << "Could not load texture \"" << filename <<"\": " << err.what() << std::endl;
+			delete newTex;
+			return nullptr;
+		}
+		
+		TextureCache::write(filename, newTex->m_image);
 	}
 	
 	newTex->initialised = false;
 	
-	//Now add it onto our list
-	loadedTextures[filename] = newTex;
-	
 	return newTex;
 }
 
 void Texture::initGL() {
 	if(!initialised) {
+		if(m_image.data == nullptr) {
+			std::cerr << "Texture was released before being sent to OpenGL" << std::endl;
+			return;
+		}
+		
+		//Drivers without S3TC get the blocks decoded back into plain RGBA
+		if(!BlockCompress::isSupported(m_image.format)) {
+			BlockCompress::decompress(m_image, m_pixels);
+		}
+		
 		//set up the texture with OpenGL
 		glGenTextures(1, &m_textureObj);
-		glBindTexture(GL_TEXTURE_2D, m_textureObj);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, m_Image->columns(), m_Image->rows(), 0, GL_RGBA, GL_UNSIGNED_BYTE, m_Blob->data());
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-		glBindTexture(GL_TEXTURE_2D, 0);
+		GLState::bindTexture(GL_TEXTURE_2D, m_textureObj);
+		for(unsigned i = 0; i < m_image.levels.size(); i++) {
+			const TextureCache::Level& level = m_image.levels[i];
+			if(BlockCompress::isCompressed(m_image.format)) {
+				glCompressedTexImage2D(GL_TEXTURE_2D, i, m_image.format, level.width, level.height, 0, level.size, m_image.data + level.offset);
+			} else {
+				glTexImage2D(GL_TEXTURE_2D, i, m_image.format, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, m_image.data + level.offset);
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, m_image.levels.size() - 1);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, TEXTURE_MIN_FILTER);
+		glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, TEXTURE_MAG_FILTER);
+		GLState::bindTexture(GL_TEXTURE_2D, 0);
 		
-		delete m_Image;
-		delete m_Blob;
-		m_Image = nullptr;
-		m_Blob = nullptr;
+		//OpenGL has its own copy now
+		releaseData();
 		
 		initialised = true;
 	}
 }
 
+void Texture::releaseData() {
+	m_image.data = nullptr;
+	m_mapping.close();
+	std::vector<unsigned char>().swap(m_pixels);
+}
+
 void Texture::bind(GLenum textureTarget) {
-	glActiveTexture(textureTarget);
+	GLState::bindTexture(textureTarget, GL_TEXTURE_2D, m_textureObj);
+}
+
+std::atomic<unsigned> Texture::sortIDCounter(1); //0 is left for objects without a texture
+
+Texture::Texture() : sortID(sortIDCounter++) {}
+
+unsigned Texture::getSortID() const {
+	return sortID;
+}
+
+TextureArray* TextureArray::create(const std::vector<Texture*>& layers) {
+	if(layers.empty()) {
+		return nullptr;
+	}
+	
+	//We need the decoded mip chains, which are let go by Texture::initGL()
+	for(const auto& i : layers) {
+		if(i == nullptr || i->m_image.data == nullptr || i->m_image.format != layers[0]->m_image.format) {
+			return nullptr;
+		}
+		if(i->m_image.levels.size() != layers[0]->m_image.levels.size() ||
+		   i->m_image.levels[0].width != layers[0]->m_image.levels[0].width || i->m_image.levels[0].height != layers[0]->m_image.levels[0].height) {
+			return nullptr;
+		}
+	}
 	
-	glBindTexture(GL_TEXTURE_2D, m_textureObj);
+	TextureArray* newArray = new TextureArray();
+	newArray->m_format = layers[0]->m_image.format;
+	newArray->m_levels = layers[0]->m_image.levels;
+	newArray->m_layers = layers.size();
+	
+	newArray->m_data.resize(newArray->m_levels.size());
+	for(unsigned level = 0; level < newArray->m_levels.size(); level++) {
+		size_t layerSize = newArray->m_levels[level].size;
+		newArray->m_data[level].resize(layerSize * layers.size());
+		for(unsigned i = 0; i < layers.size(); i++) {
+			memcpy(&newArray->m_data[level][layerSize * i], layers[i]->m_image.data + newArray->m_levels[level].offset, layerSize);
+		}
+	}
+	
+	newArray->initialised = false;
+	
+	return newArray;
+}
+
+void TextureArray::initGL() {
+	if(!initialised) {
+		glGenTextures(1, &m_textureObj);
+		GLState::bindTexture(GL_TEXTURE_2D_ARRAY, m_textureObj);
+		for(unsigned i = 0; i < m_levels.size(); i++) {
+			const TextureCache::Level& level = m_levels[i];
+			if(!BlockCompress::isCompressed(m_format)) {
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, i, m_format, level.width, level.height, m_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &m_data[i][0]);
+			} else if(BlockCompress::isSupported(m_format)) {
+				glCompressedTexImage3D(GL_TEXTURE_2D_ARRAY, i, m_format, level.width, level.height, m_layers, 0, level.size * m_layers, &m_data[i][0]);
+			} else {
+				//Drivers without S3TC get each layer decoded back into plain RGBA
+				size_t layerSize = BlockCompress::levelSize(GL_RGBA8, level.width, level.height);
+				std::vector<unsigned char> rgba(layerSize * m_layers);
+				for(unsigned layer = 0; layer < m_layers; layer++) {
+					BlockCompress::decompressLevel(m_format, &m_data[i][level.size * layer], level.width, level.height, &rgba[layerSize * layer]);
+				}
+				glTexImage3D(GL_TEXTURE_2D_ARRAY, i, GL_RGBA8, level.width, level.height, m_layers, 0, GL_RGBA, GL_UNSIGNED_BYTE, &rgba[0]);
+			}
+		}
+		glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, m_levels.size() - 1);
+		glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, TEXTURE_MIN_FILTER);
+		glTexParameterf(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, TEXTURE_MAG_FILTER);
+		GLState::bindTexture(GL_TEXTURE_2D_ARRAY, 0);
+		
+		//OpenGL has its own copy now
+		std::vector<std::vector<unsigned char>>().swap(m_data);
+		
+		initialised = true;
+	}
+}
+
+void TextureArray::bind(GLenum textureTarget) {
+	GLState::bindTexture(textureTarget, GL_TEXTURE_2D_ARRAY, m_textureObj);
 }
 
-Texture::Texture(){}
+TextureArray::TextureArray(){}
 
 #endif /* model */
\ No newline at end of file
@@ -1,15 +1,21 @@
 #include <Menu.h>
 #include "object.h"
+#include "physics_world.h"
 
 glm::mat4* Object::viewMatrix;
 glm::mat4* Object::projectionMatrix;
 Menu* Object::menu;
+PhysicsWorld* Object::physics;
 int Object::idCounter = 1;
 
-Object::Object(const Context &a) : ctx(a), originalCtx(a), position(_position) {
+Object::Object(const Context &a) : ctx(a), originalCtx(a), position(_position), boundCenter(_boundCenter), boundRadius(_boundRadius) {
 	//Default value - just in case anything tries to read it
 	//The planet doesn't actually start here - this will be updated in Update()
 	_position = {a.xLoc, a.yLoc, a.zLoc};
+	_boundCenter = _position;
+	_boundRadius = 0.0f;
+	dynamic = std::find(ctx.flags.begin(), ctx.flags.end(), "dynamic") != ctx.flags.end();
+	moved = true;
 	modelMat = glm::translate(modelMat, position);
 	ctx.id = idCounter;
 	idCounter++;
@@ -17,11 +23,7 @@ Object::Object(const Context &a) : ctx(a), originalCtx(a), position(_position) {
 
 Object::~Object() {}
 
-void Object::Init_GL(std::unordered_map<std::string, std::string> const * dictionary) {
-	//Initialise shaders
-	ctx.shader->Initialize(dictionary);
-	ctx.altShader->Initialize(dictionary);
-	
+void Object::Init_GL() {
 	//Initialise models
 	if(ctx.model != nullptr)
 	{
@@ -29,7 +31,8 @@ void Object::Init_GL(std::unordered_map<std::string, std::string> const * dictio
 	}
 
 	//Initialise textures
-	if(ctx.texture != nullptr) {
+	//Instanced objects draw from their group's texture array instead
+	if(ctx.texture != nullptr && ctx.instanceGroup == -1) {
 		ctx.texture->initGL();
 	}
 	if(ctx.altTexture != nullptr) {
@@ -44,12 +47,13 @@ void Object::Init_GL(std::unordered_map<std::string, std::string> const * dictio
 }
 
 void Object::Update(float dt) {
-	btTransform transformObject;
-	ctx.physicsBody->getMotionState()->getWorldTransform(transformObject);
+	//Interpolated between the last two steps, so motion stays smooth whatever the frame rate
+	btTransform transformObject = physics->interpolatedTransform(ctx.rigidBodyIndex);
 
 	//16 element matrix
 	float mat[16];
 	transformObject.getOpenGLMatrix(mat);
+	glm::mat4 lastModelMat = modelMat;
 	modelMat = glm::make_mat4(mat);
 	if(ctx.expansionTimer == 0) {
 		modelMat = glm::scale(modelMat, ctx.scale);
@@ -62,73 +66,106 @@ void Object::Update(float dt) {
 	}
 	
 	_position = glm::vec3(modelMat * glm::vec4(0.0, 0.0, 0.0, 1.0));
+	
+	//Resting bodies still jitter a tiny bit, which isn't worth redrawing anything for
+	moved = false;
+	for(int i = 0; i < 4 && !moved; i++) {
+		glm::vec4 change = glm::abs(modelMat[i] - lastModelMat[i]);
+		moved = std::max(std::max(change.x, change.y), std::max(change.z, change.w)) > OBJECT_MOVE_EPSILON;
+	}
+	
+	//Move the model's bounding sphere into the world, growing it by the largest scale
+	if(ctx.model != nullptr) {
+		float scale = std::max(glm::length(glm::vec3(modelMat[0])), std::max(glm::length(glm::vec3(modelMat[1])), glm::length(glm::vec3(modelMat[2]))));
+		_boundCenter = glm::vec3(modelMat * glm::vec4(ctx.model->bounds.center, 1.0));
+		_boundRadius = ctx.model->bounds.radius * scale;
+	}
 }
 
 const glm::mat4& Object::GetModel() const {
 	return modelMat;
 }
 
-void Object::Render(bool withShadows, std::vector<glm::mat4> spotlightMatrices) const {
-	//Send our shaders the MVP matrices
-	glm::mat4 modelViewMatrix = *viewMatrix * modelMat;
-	ctx.shader->uniformMatrix4fv("modelMatrix", 1, GL_FALSE, glm::value_ptr(modelMat));
-	ctx.shader->uniformMatrix4fv("modelViewMatrix", 1, GL_FALSE, glm::value_ptr(modelViewMatrix));
+float Object::ScreenSize() const {
+	glm::vec3 eyePosition = glm::vec3(*viewMatrix * glm::vec4(boundCenter, 1.0));
+	float distance = glm::length(eyePosition);
 	
-	if(withShadows) {
-		std::vector<float> rawMatrices(spotlightMatrices.size() * 16);
-		for(int i = 0; i < spotlightMatrices.size(); i++) {
-			spotlightMatrices[i] = spotlightMatrices[i] * modelMat;
-			for(int j = 0; j < 4; j++) {
-				for(int k = 0; k < 4; k++) {
-					rawMatrices[16 * i + 4 * j + k] = spotlightMatrices[i][j][k];
-				}
-			}
-		}
-
-		ctx.shader->uniformMatrix4fv("biasMVP", spotlightMatrices.size(), GL_FALSE, &rawMatrices[0]);
+	//The camera is inside the sphere, so it fills the screen
+	if(distance <= boundRadius) {
+		return 1.0f;
 	}
 	
-	//If we have a texture, use it
-	if(ctx.texture != nullptr) {
-		ctx.texture->bind(GL_COLOR_TEXTURE);
-		ctx.shader->uniform1i("gSampler", GL_COLOR_TEXTURE_OFFSET);
-	}
-	if(ctx.altTexture != nullptr) {
-		ctx.altTexture->bind(GL_ALT_TEXTURE);
-		ctx.shader->uniform1i("gAltSampler", GL_ALT_TEXTURE_OFFSET);
-	}
-	if(ctx.normalMap != nullptr) {
-		ctx.normalMap->bind(GL_NORMAL_TEXTURE);
-		ctx.shader->uniform1i("gNormalSampler", GL_NORMAL_TEXTURE_OFFSET);
-	}
-	if(ctx.specularMap != nullptr) {
-		ctx.specularMap->bind(GL_SPECULAR_TEXTURE);
-		ctx.shader->uniform1i("gSpecularSampler", GL_SPECULAR_TEXTURE_OFFSET);
+	return boundRadius / distance * (*projectionMatrix)[1][1];
+}
+
+bool Object::IsDynamic() const {
+	return dynamic;
+}
+
+bool Object::Moved() const {
+	return moved;
+}
+
+ShaderFeatures Object::Features(unsigned shadowSamples) const {
+	ShaderFeatures features;
+	features.hasTexture = ctx.texture != nullptr;
+	features.hasNormalMap = ctx.normalMap != nullptr;
+	features.hasSpecularMap = ctx.specularMap != nullptr;
+	features.shadowSamples = shadowSamples;
+	
+	return features;
+}
+
+Shader* Object::GetShader(unsigned shadowSamples) const {
+	return ctx.shader->variant(Features(shadowSamples));
+}
+
+void Object::Render(Shader* shader, bool bindTextures) const {
+	//Matrices come from the ObjectData uniform block
+	
+	if(bindTextures) {
+		//If we have a texture, use it
+		if(ctx.texture != nullptr) {
+			ctx.texture->bind(GL_COLOR_TEXTURE);
+			shader->uniform1i(UNIFORM_SAMPLER, GL_COLOR_TEXTURE_OFFSET);
+		}
+		if(ctx.altTexture != nullptr) {
+			ctx.altTexture->bind(GL_ALT_TEXTURE);
+			shader->uniform1i(UNIFORM_ALT_SAMPLER, GL_ALT_TEXTURE_OFFSET);
+		}
+		if(ctx.normalMap != nullptr) {
+			ctx.normalMap->bind(GL_NORMAL_TEXTURE);
+			shader->uniform1i(UNIFORM_NORMAL_SAMPLER, GL_NORMAL_TEXTURE_OFFSET);
+		}
+		if(ctx.specularMap != nullptr) {
+			ctx.specularMap->bind(GL_SPECULAR_TEXTURE);
+			shader->uniform1i(UNIFORM_SPECULAR_SAMPLER, GL_SPECULAR_TEXTURE_OFFSET);
+		}
 	}
 
 	//Now draw our planet
-	ctx.model->drawModel(ctx.shader);
+	//Textures are left bound so the next object can reuse them
+	ctx.model->drawModel(shader, Model::selectLOD(ScreenSize(), false));
+}
 
-	glBindTexture(GL_TEXTURE_2D, 0);
+bool Object::SameTextures(const Object* other) const {
+	return ctx.texture == other->ctx.texture && ctx.altTexture == other->ctx.altTexture &&
+	       ctx.normalMap == other->ctx.normalMap && ctx.specularMap == other->ctx.specularMap;
 }
 
 void Object::RenderID(Shader* shader) const {
 	//Send our shaders the MVP matrices
 	glm::mat4 MVPMatrix = *projectionMatrix * *viewMatrix * modelMat;
-	shader->uniformMatrix4fv("MVP", 1, GL_FALSE, glm::value_ptr(MVPMatrix));
-	shader->uniformMatrix4fv("M", 1, GL_FALSE, glm::value_ptr(modelMat));
+	shader->uniformMatrix4fv(UNIFORM_MVP, 1, GL_FALSE, glm::value_ptr(MVPMatrix));
+	shader->uniformMatrix4fv(UNIFORM_MODEL, 1, GL_FALSE, glm::value_ptr(modelMat));
 	float modifiedID = ctx.id;
-	shader->uniform1fv("id", 1, &modifiedID);
+	shader->uniform1fv(UNIFORM_ID, 1, &modifiedID);
 	
 	//Now draw our planet
-	ctx.model->drawModel(nullptr);
+	ctx.model->drawModelDepth(Model::selectLOD(ScreenSize(), false));
 }
 
-void Object::RenderShadow(Shader* shader, const glm::mat4& lightMatrix) const {
-	//Send our shaders the MVP matrices
-	glm::mat4 MVPMatrix = lightMatrix * modelMat;
-	shader->uniformMatrix4fv("MVP", 1, GL_FALSE, glm::value_ptr(MVPMatrix));
-	
-	//Now draw our planet
-	ctx.model->drawModel(nullptr);
+void Object::RenderShadow() const {
+	//Matrices come from the ObjectData uniform block
+	ctx.model->drawModelDepth(Model::selectLOD(ScreenSize(), true));
 }
\ No newline at end of file
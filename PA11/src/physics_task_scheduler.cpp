@@ -0,0 +1,154 @@
+#include "physics_task_scheduler.h"
+
+#ifdef BULLET_MULTITHREADED
+
+#include <algorithm>
+#include <iostream>
+#include <thread>
+
+PhysicsTaskScheduler::PhysicsTaskScheduler(JobPool& pool) : btITaskScheduler("JobPool"), m_pool(pool), m_threads(pool.size() + 1), m_busy(false),
+                                                            m_loop(0), m_participants(0), m_stopping(false),
+                                                            m_forBody(nullptr), m_sumBody(nullptr), m_begin(0), m_end(0),
+                                                            m_chunkSize(1), m_chunkCount(0), m_nextChunk(0), m_pending(0) {
+	m_sums.resize(getMaxNumThreads());
+	
+	for (unsigned i = 0; i < m_pool.size(); i++) {
+		m_workers.push_back(m_pool.submit<void>(std::bind(&PhysicsTaskScheduler::work, this)));
+	}
+}
+
+PhysicsTaskScheduler::~PhysicsTaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stopping = true;
+	}
+	m_wake.notify_all();
+	
+	for (auto& i : m_workers) {
+		i.get();
+	}
+}
+
+int PhysicsTaskScheduler::getMaxNumThreads() const {
+	return m_pool.size() + 1;
+}
+
+int PhysicsTaskScheduler::getNumThreads() const {
+	return m_threads;
+}
+
+void PhysicsTaskScheduler::setNumThreads(int numThreads) {
+	m_threads = std::max(1, std::min(numThreads, getMaxNumThreads()));
+}
+
+int PhysicsTaskScheduler::chunkCount(int begin, int end, int grainSize) const {
+	if (m_busy) return 1;
+	
+	int grains = (end - begin + grainSize - 1) / std::max(grainSize, 1);
+	return std::max(1, std::min(grains, m_threads));
+}
+
+void PhysicsTaskScheduler::parallelFor(int begin, int end, int grainSize, const btIParallelForBody& body) {
+	int chunks = chunkCount(begin, end, grainSize);
+	if (chunks == 1) {
+		body.forLoop(begin, end);
+		return;
+	}
+	
+	runLoop(begin, end, chunks, &body, nullptr);
+}
+
+btScalar PhysicsTaskScheduler::parallelSum(int begin, int end, int grainSize, const btIParallelSumBody& body) {
+	int chunks = chunkCount(begin, end, grainSize);
+	if (chunks == 1) {
+		return body.sumLoop(begin, end);
+	}
+	
+	runLoop(begin, end, chunks, nullptr, &body);
+	
+	btScalar sum = 0;
+	for (int i = 0; i < m_chunkCount; i++) {
+		sum += m_sums[i];
+	}
+	
+	return sum;
+}
+
+void PhysicsTaskScheduler::runLoop(int begin, int end, int chunks, const btIParallelForBody* forBody, const btIParallelSumBody* sumBody) {
+	m_busy = true;
+	
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_forBody = forBody;
+		m_sumBody = sumBody;
+		m_begin = begin;
+		m_end = end;
+		//Rounding the size up can leave fewer pieces than asked for
+		m_chunkSize = (end - begin + chunks - 1) / chunks;
+		m_chunkCount = (end - begin + m_chunkSize - 1) / m_chunkSize;
+		m_nextChunk = 0;
+		
+		//This thread is Bullet's 0, so workers 1 and up take the rest
+		m_participants = m_chunkCount;
+		m_pending = m_chunkCount - 1;
+		m_loop++;
+	}
+	m_wake.notify_all();
+	
+	runChunks();
+	
+	//Pieces are taken by whoever's free, so this only waits for the last ones to finish and for slow workers to notice
+	while (m_pending > 0) {
+		std::this_thread::yield();
+	}
+	
+	m_busy = false;
+}
+
+void PhysicsTaskScheduler::runChunks() {
+	int chunk;
+	while ((chunk = m_nextChunk++) < m_chunkCount) {
+		int begin = m_begin + chunk * m_chunkSize;
+		int end = std::min(begin + m_chunkSize, m_end);
+		
+		if (m_forBody != nullptr) {
+			m_forBody->forLoop(begin, end);
+		} else {
+			m_sums[chunk] = m_sumBody->sumLoop(begin, end);
+		}
+	}
+}
+
+void PhysicsTaskScheduler::work() {
+	//Not asked for until the first loop, by which point the stepping thread has been numbered first
+	int index = -1;
+	unsigned seen = 0;
+	
+	std::unique_lock<std::mutex> lock(m_mutex);
+	while (true) {
+		while (m_loop == seen && !m_stopping) {
+			m_wake.wait(lock);
+		}
+		if (m_stopping) {
+			return;
+		}
+		seen = m_loop;
+		
+		if (index < 0) {
+			index = btGetCurrentThreadIndex();
+			if (index == 0 || index >= getMaxNumThreads()) {
+				std::cerr << "Physics worker was given thread index " << index << " - the scheduler must be installed from the stepping thread" << std::endl;
+			}
+		}
+		if (index == 0 || index >= m_participants) {
+			continue;
+		}
+		
+		lock.unlock();
+		runChunks();
+		m_pending--;
+		lock.lock();
+	}
+}
+
+#endif /* BULLET_MULTITHREADED */
@@ -2,10 +2,40 @@
 #define PHYSICS_WORLD
 
 #include "physics_world.h"
+#include "model.h"
+#include "bvh_cache.h"
+#include "convex_decomposition.h"
+
+#ifdef BULLET_MULTITHREADED
+#include <BulletCollision/CollisionDispatch/btCollisionDispatcherMt.h>
+#include <BulletDynamics/ConstraintSolver/btSequentialImpulseConstraintSolverMt.h>
+#include <BulletDynamics/Dynamics/btDiscreteDynamicsWorldMt.h>
+#endif
 
 GameWorld::ctx* PhysicsWorld::game;
 
-PhysicsWorld::PhysicsWorld() {
+PhysicsWorld::PhysicsWorld(bool multithreaded, unsigned threads) : m_jobPool(nullptr), m_taskScheduler(nullptr), m_solverPool(nullptr),
+                                                                 m_running(false), m_paused(false), m_threadState(THREAD_STARTING), m_benchmarkSteps(0),
+                                                                 m_commandsSent(0), m_commandsRun(0),
+                                                                 m_writeIndex(1), m_readIndex(0), m_readyIndex(2), m_alpha(1.0f) {
+	if (threads == 0) {
+		threads = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+#ifdef BULLET_MULTITHREADED
+	//Bullet can't number any more threads than this
+	threads = std::min(threads, unsigned(BT_MAX_THREAD_COUNT));
+#endif
+	if (multithreaded && threads == 1) {
+		std::cout << "Only one physics thread was asked for, so the single threaded world will be used" << std::endl;
+		multithreaded = false;
+	}
+#ifndef BULLET_MULTITHREADED
+	if (multithreaded) {
+		std::cerr << "Multithreaded physics needs a build with BULLET_MULTITHREADED, so the single threaded world will be used" << std::endl;
+		multithreaded = false;
+	}
+#endif
+	
 	// ====================== <Initialization> ===================
 	
 	// Create a *broadphase*
@@ -21,19 +51,51 @@ PhysicsWorld::PhysicsWorld() {
 	// Create a *dispatcher*
 	// Takes collision config pointer as a parameter
 	// Along with collisionConfig, it sends events to the objects
-	dispatcher = new btCollisionDispatcher(collisionConfiguration);
-	
 	//Create a solver
 	// Causes objects to interact properly, taking into account gravity, forces, collisions, hinge constraints
 	// World and Objects are both handled with this pointer.
-	solver = new btSequentialImpulseConstraintSolver;
 	
 	// Create World!
 	// World uses the initialization parameters
-	dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+#ifdef BULLET_MULTITHREADED
+	if (multithreaded) {
+		//The physics thread runs a share of each loop too, so the pool has one less
+		m_jobPool = new JobPool(threads - 1);
+		m_taskScheduler = new PhysicsTaskScheduler(*m_jobPool);
+	}
+#endif
+	
+	//The physics thread installs the scheduler, which the multithreaded dispatcher and solvers are sized by
+	m_thread = std::thread(&PhysicsWorld::threadMain, this);
+	{
+		std::unique_lock<std::mutex> lock(m_threadMutex);
+		while (m_threadState == THREAD_STARTING) {
+			m_threadStateChanged.wait(lock);
+		}
+	}
+	
+#ifdef BULLET_MULTITHREADED
+	if (multithreaded) {
+		dispatcher = new btCollisionDispatcherMt(collisionConfiguration);
+		//Islands are solved in parallel, each taking whichever of these solvers is free
+		m_solverPool = new btConstraintSolverPoolMt(threads);
+		solver = new btSequentialImpulseConstraintSolverMt;
+		dynamicsWorld = new btDiscreteDynamicsWorldMt(dispatcher, broadphase, m_solverPool, solver, collisionConfiguration);
+	} else
+#endif
+	{
+		dispatcher = new btCollisionDispatcher(collisionConfiguration);
+		solver = new btSequentialImpulseConstraintSolver;
+		dynamicsWorld = new btDiscreteDynamicsWorld(dispatcher, broadphase, solver, collisionConfiguration);
+	}
 	
 	// ====================== </Initialization> ==================
 	
+	m_pickConfiguration = new btDefaultCollisionConfiguration();
+	m_pickDispatcher = new btCollisionDispatcher(m_pickConfiguration);
+	m_pickBroadphase = new btDbvtBroadphase();
+	m_pickWorld = new btCollisionWorld(m_pickDispatcher, m_pickBroadphase, m_pickConfiguration);
+	
 	// Earth Gravity in the Y direction
 	dynamicsWorld->setGravity(btVector3(0, -5.6f, 0));
 	
@@ -58,22 +120,63 @@ PhysicsWorld::PhysicsWorld() {
 }
 
 PhysicsWorld::~PhysicsWorld() {
+	stop();
+	
 	// Remove Objects/Shapes
 	for (int i = 0; i < loadedBodies.size(); i++) {
 		dynamicsWorld->removeCollisionObject(loadedBodies[i]);
 		btMotionState* motionState = loadedBodies[i]->getMotionState();
-		btCollisionShape* collisionShape = loadedBodies[i]->getCollisionShape();
 		delete loadedBodies[i];
 		loadedBodies[i] = nullptr;
 		delete motionState;
-		delete collisionShape;
 	}
 	
+	for (auto& i : m_pickObjects) {
+		m_pickWorld->removeCollisionObject(i);
+		delete i;
+	}
+	m_pickObjects.clear();
+	delete m_pickWorld;
+	delete m_pickBroadphase;
+	delete m_pickDispatcher;
+	delete m_pickConfiguration;
+	m_pickWorld = nullptr;
+	m_pickBroadphase = nullptr;
+	m_pickDispatcher = nullptr;
+	m_pickConfiguration = nullptr;
+	
+	//Shapes are shared, so they're only deleted once every body is gone
+	for (auto& i : m_shapes) {
+		//Compound shapes don't own their parts
+		if (i.second->isCompound()) {
+			btCompoundShape* compound = static_cast<btCompoundShape*>(i.second);
+			for (int j = 0; j < compound->getNumChildShapes(); j++) {
+				delete compound->getChildShape(j);
+			}
+		}
+		delete i.second;
+	}
+	m_shapes.clear();
+	for (auto& i : m_triangleMeshes) {
+		delete i.second;
+	}
+	m_triangleMeshes.clear();
+	for (auto& i : m_bvhBuffers) {
+		btAlignedFree(i);
+	}
+	m_bvhBuffers.clear();
+	
 	// Remove World
 	delete broadphase;
 	delete collisionConfiguration;
 	delete dispatcher;
 	delete solver;
+#ifdef BULLET_MULTITHREADED
+	//The physics thread uninstalled it before stopping
+	delete m_solverPool;
+	delete m_taskScheduler;
+#endif
+	delete m_jobPool;
 	//todo: floor is not a loaded body currently and thus not deleted - causes dynamics world delete to segfault
 //	delete dynamicsWorld;
 	
@@ -82,6 +185,9 @@ PhysicsWorld::~PhysicsWorld() {
 	dispatcher = nullptr;
 	solver = nullptr;
 	dynamicsWorld = nullptr;
+	m_jobPool = nullptr;
+	m_taskScheduler = nullptr;
+	m_solverPool = nullptr;
 }
 
 
@@ -92,7 +198,7 @@ int PhysicsWorld::addBody(btRigidBody* bodyToAdd) {
 	return (int) loadedBodies.size() - 1;
 }
 
-int PhysicsWorld::createObject(std::string objectName, btTriangleMesh* objTriMesh, PhysicsWorld::Context* objCtx) {
+int PhysicsWorld::createObject(std::string objectName, PhysicsWorld::Context* objCtx) {
 	
 	int flags = 0;
 	btVector3 inertia(0, 0, 0);
@@ -125,33 +231,7 @@ int PhysicsWorld::createObject(std::string objectName, btTriangleMesh* objTriMes
 	
 	// Rotate about axis (using vec3) by an angle.
 	
-	btCollisionShape* newShape;
-	
-	if (objCtx->shape == 1) {   // SPHERE
-		btScalar radius = objCtx->radius;
-		newShape = new btSphereShape(radius * objCtx->scale);
-	} else if (objCtx->shape ==
-	           2) {   // BOX - half-extends are the half the height/width/depth of the box (from a point p out)
-		btVector3 boxHalfExtents = {objCtx->widthX * objCtx->scaleX, objCtx->heightY * objCtx->scaleY,
-		                            objCtx->lengthZ * objCtx->scaleZ};
-		newShape = new btBoxShape(boxHalfExtents);
-	} else if (objCtx->shape == 3) {   // CYLINDER
-		btVector3 boxHalfExtents = {1 * objCtx->scaleX, 1 * objCtx->scaleY, 1 * objCtx->scaleX};
-		newShape = new btCylinderShape(boxHalfExtents);
-	} else if (objCtx->shape == 4) {   // PLANE(ground)
-		// The plane's normal (direction, [0,1,0] means it faces up in the y direction
-		// defined by a 1 in the config file object's width(x), height(y), or depth(z)
-		btVector3 planeNormal = {objCtx->widthX, objCtx->heightY, objCtx->lengthZ};
-		// using default of 1 for thickness of plane
-		btScalar planeConstant = 0;
-		newShape = new btStaticPlaneShape(planeNormal, planeConstant);
-	}
-		// create shape from mesh
-	else if (!isDynamic) {
-		newShape = new btBvhTriangleMeshShape(objTriMesh, true);
-	} else {
-		newShape = new btConvexTriangleMeshShape(objTriMesh, true);
-	}
+	btCollisionShape* newShape = getShape(*objCtx, isDynamic);
 	
 	// inertia vector
 	
@@ -230,30 +310,386 @@ int PhysicsWorld::createObject(std::string objectName, btTriangleMesh* objTriMes
 	return bodyIndex;
 }
 
+btCollisionShape* PhysicsWorld::getShape(const Context& objCtx, bool isDynamic) {
+	ShapeKey key;
+	key.shape = objCtx.shape;
+	key.mesh = nullptr;
+	key.dynamic = false;
+	key.exact = false;
+	
+	if (objCtx.shape == 1) {   // SPHERE
+		key.size = btVector3(objCtx.radius * objCtx.scale, 0, 0);
+	} else if (objCtx.shape == 2) {   // BOX - half-extends are the half the height/width/depth of the box (from a point p out)
+		key.size = btVector3(objCtx.widthX * objCtx.scaleX, objCtx.heightY * objCtx.scaleY, objCtx.lengthZ * objCtx.scaleZ);
+	} else if (objCtx.shape == 3) {   // CYLINDER
+		key.size = btVector3(1 * objCtx.scaleX, 1 * objCtx.scaleY, 1 * objCtx.scaleX);
+	} else if (objCtx.shape == 4) {   // PLANE(ground)
+		// The plane's normal (direction, [0,1,0] means it faces up in the y direction
+		// defined by a 1 in the config file object's width(x), height(y), or depth(z)
+		key.size = btVector3(objCtx.widthX, objCtx.heightY, objCtx.lengthZ);
+	} else {   // MESH
+		key.shape = 0;
+		key.size = objCtx.meshScale;
+		key.mesh = objCtx.mesh;
+		key.dynamic = isDynamic;
+		//For checking the simplified shapes against the mesh they came from
+		key.exact = isDynamic && std::find(objCtx.flags->begin(), objCtx.flags->end(), "exact-collision") != objCtx.flags->end();
+	}
+	
+	auto found = m_shapes.find(key);
+	if (found != m_shapes.end()) {
+		return found->second;
+	}
+	
+	btCollisionShape* newShape;
+	if (key.shape == 1) {
+		newShape = new btSphereShape(key.size.x());
+	} else if (key.shape == 2) {
+		newShape = new btBoxShape(key.size);
+	} else if (key.shape == 3) {
+		newShape = new btCylinderShape(key.size);
+	} else if (key.shape == 4) {
+		// using default of 1 for thickness of plane
+		btScalar planeConstant = 0;
+		newShape = new btStaticPlaneShape(key.size, planeConstant);
+	}
+		// create shape from mesh
+	else if (!isDynamic) {
+		newShape = createStaticMeshShape(objCtx.meshFile, key.mesh, key.size);
+	} else if (key.exact) {
+		newShape = new btConvexTriangleMeshShape(getTriangleMesh(key.mesh, key.size), true);
+	} else {
+		//Checking a few hull vertices is much cheaper than every triangle, and concave meshes keep their shape
+		newShape = ConvexDecomposition::createShape(getTriangleMesh(key.mesh, key.size));
+	}
+	
+	m_shapes[key] = newShape;
+	return newShape;
+}
+
+btTriangleMesh* PhysicsWorld::getTriangleMesh(const Model* mesh, const btVector3& scale) {
+	TriangleMeshKey key;
+	key.mesh = mesh;
+	key.scale = scale;
+	
+	auto found = m_triangleMeshes.find(key);
+	if (found != m_triangleMeshes.end()) {
+		return found->second;
+	}
+	
+	btTriangleMesh* triangles = new btTriangleMesh();
+	if (mesh != nullptr) {
+		for (const auto& m : mesh->meshes) {
+			for (int i = 0; i < m._indices.size() / 3; i++) {
+				btVector3 triArray[3];
+				for (int j = 0; j < 3; j++) {
+					glm::vec3 position = m._vertices[m._indices[3 * i + j]].vertex;
+					triArray[j] = btVector3(position.x, position.y, position.z) * scale;
+				}
+				
+				triangles->addTriangle(triArray[0], triArray[1], triArray[2]);
+			}
+		}
+	}
+	
+	m_triangleMeshes[key] = triangles;
+	return triangles;
+}
+
+btBvhTriangleMeshShape* PhysicsWorld::createStaticMeshShape(const std::string& meshFile, const Model* mesh, const btVector3& scale) {
+	btTriangleMesh* triangles = getTriangleMesh(mesh, scale);
+	if (meshFile.empty()) {
+		return new btBvhTriangleMeshShape(triangles, true);
+	}
+	
+	void* buffer = nullptr;
+	btOptimizedBvh* bvh = BvhCache::read(meshFile, scale, triangles, buffer);
+	if (bvh != nullptr) {
+		btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(triangles, true, false);
+		shape->setOptimizedBvh(bvh);
+		m_bvhBuffers.push_back(buffer);
+		return shape;
+	}
+	
+	btBvhTriangleMeshShape* shape = new btBvhTriangleMeshShape(triangles, true);
+	BvhCache::write(meshFile, scale, triangles, shape->getOptimizedBvh());
+	return shape;
+}
+
+bool PhysicsWorld::ShapeKey::operator<(const ShapeKey& other) const {
+	return std::make_tuple(shape, size.x(), size.y(), size.z(), mesh, dynamic, exact) <
+	       std::make_tuple(other.shape, other.size.x(), other.size.y(), other.size.z(), other.mesh, other.dynamic, other.exact);
+}
+
+bool PhysicsWorld::TriangleMeshKey::operator<(const TriangleMeshKey& other) const {
+	return std::make_tuple(mesh, scale.x(), scale.y(), scale.z()) <
+	       std::make_tuple(other.mesh, other.scale.x(), other.scale.y(), other.scale.z());
+}
+
 std::vector<btRigidBody*>* PhysicsWorld::getLoadedBodies() {
 	return &loadedBodies;
 }
 
-void PhysicsWorld::update(float dt) {
-	// The time between ticks of checking for collisions in the world.
-	dynamicsWorld->stepSimulation(dt / 1000, 25);
+void PhysicsWorld::rayTest(const btVector3& from, const btVector3& to, std::vector<RayHit>& hits) {
+	hits.clear();
+	
+	//Test against where bodies are drawn, not where the physics thread has got to
+	for (int i = 0; i < m_pickObjects.size(); i++) {
+		m_pickObjects[i]->setWorldTransform(interpolatedTransform(i));
+	}
+	m_pickWorld->updateAabbs();
+	
+	btCollisionWorld::AllHitsRayResultCallback result(from, to);
+	m_pickWorld->rayTest(from, to, result);
+	
+	for (int i = 0; i < result.m_collisionObjects.size(); i++) {
+		const btCollisionObject* object = result.m_collisionObjects[i];
+		RayHit hit;
+		hit.body = loadedBodies[object->getUserIndex()];
+		hit.point = result.m_hitPointWorld[i];
+		hit.offset = hit.point - object->getWorldTransform().getOrigin();
+		hit.fraction = result.m_hitFractions[i];
+		hits.push_back(hit);
+	}
+	
+	std::sort(hits.begin(), hits.end(), compareRayHits);
+}
+
+bool PhysicsWorld::compareRayHits(const RayHit& a, const RayHit& b) {
+	return a.fraction < b.fraction;
 }
 
-// On each physics tick, clamp the ball velocities
-static void myTickCallback(btDynamicsWorld* world, btScalar timeStep) {
-	// This section clamps the velocity (mMaxSpeed) of objects that are set to be clamped
-	PhysicsWorld* tempWorld = static_cast<PhysicsWorld*>(world->getWorldUserInfo());
-	int mMaxSpeed = 200;
+void PhysicsWorld::start() {
+	if (m_running || !m_thread.joinable()) return;
+	
+	m_lastStates.resize(loadedBodies.size());
+	for (auto& i : m_snapshots) {
+		i.previous.resize(loadedBodies.size());
+		i.current.resize(loadedBodies.size());
+	}
+	
+	//The render thread needs somewhere to start before the first step
+	publishSnapshot(false);
+	updateSnapshot();
 	
+	for (int i = m_pickObjects.size(); i < loadedBodies.size(); i++) {
+		btCollisionObject* pickObject = new btCollisionObject();
+		pickObject->setCollisionShape(loadedBodies[i]->getCollisionShape());
+		pickObject->setUserIndex(i);
+		m_pickWorld->addCollisionObject(pickObject);
+		m_pickObjects.push_back(pickObject);
+	}
+	
+	m_running = true;
+	{
+		std::lock_guard<std::mutex> lock(m_threadMutex);
+		m_threadState = THREAD_STEPPING;
+	}
+	m_threadStateChanged.notify_all();
+}
+
+void PhysicsWorld::stop() {
+	if (!m_thread.joinable()) return;
+	
+	m_running = false;
+	{
+		std::lock_guard<std::mutex> lock(m_threadMutex);
+		m_threadState = THREAD_EXITING;
+	}
+	m_threadStateChanged.notify_all();
+	m_thread.join();
+}
+
+void PhysicsWorld::setPaused(bool paused) {
+	m_paused = paused;
+}
+
+void PhysicsWorld::applyImpulse(int body, const btVector3& impulse, const btVector3& point) {
+	Command command;
+	command.type = Command::IMPULSE;
+	command.body = body;
+	command.vector = impulse;
+	command.point = point;
+	
+	if (m_commands.push(command)) {
+		m_commandsSent++;
+	} else {
+		std::cerr << "Physics command queue is full, dropping an impulse" << std::endl;
+	}
+}
+
+void PhysicsWorld::placeBody(int body, const btVector3& origin) {
+	Command command;
+	command.type = Command::PLACE;
+	command.body = body;
+	command.vector = origin;
+	
+	if (m_commands.push(command)) {
+		m_commandsSent++;
+	} else {
+		std::cerr << "Physics command queue is full, dropping a placement" << std::endl;
+	}
+}
+
+void PhysicsWorld::threadMain() {
+#ifdef BULLET_MULTITHREADED
+	//Bullet numbers threads in the order they first call into it, and only takes a scheduler from the first
+	//This is the only thread that steps the world, so it takes that place and the scheduler's workers come after it
+	if (m_taskScheduler != nullptr) {
+		btSetTaskScheduler(m_taskScheduler);
+	}
+#endif
+	
+	std::unique_lock<std::mutex> lock(m_threadMutex);
+	m_threadState = THREAD_IDLE;
+	m_threadStateChanged.notify_all();
+	
+	while (m_threadState != THREAD_EXITING) {
+		if (m_threadState == THREAD_IDLE) {
+			m_threadStateChanged.wait(lock);
+			continue;
+		}
+		
+		ThreadState task = m_threadState;
+		lock.unlock();
+		if (task == THREAD_STEPPING) {
+			run();
+		} else {
+			runBenchmark();
+		}
+		lock.lock();
+		
+		//Unless stop() has been called meanwhile
+		if (m_threadState == task) {
+			m_threadState = THREAD_IDLE;
+			m_threadStateChanged.notify_all();
+		}
+	}
+	lock.unlock();
+	
+#ifdef BULLET_MULTITHREADED
+	if (m_taskScheduler != nullptr) {
+		btSetTaskScheduler(nullptr);
+	}
+#endif
+}
+
+void PhysicsWorld::run() {
+	const std::chrono::nanoseconds step(1000000000 / PHYSICS_STEP_RATE);
+	std::chrono::steady_clock::time_point next = std::chrono::steady_clock::now();
+	
+	while (m_running) {
+		bool placed = runCommands();
+		if (!m_paused) {
+			//No substeps, so every call is exactly one step
+			dynamicsWorld->stepSimulation(btScalar(1.0) / PHYSICS_STEP_RATE, 0);
+			publishSnapshot(true);
+		} else if (placed) {
+			//Still show bodies being moved around while paused
+			publishSnapshot(false);
+		}
+		
+		//Steps run back to back until they've caught up, unless they've fallen too far behind to bother
+		next += step;
+		std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+		if (now - next > step * PHYSICS_MAX_CATCH_UP) {
+			next = now;
+		}
+		std::this_thread::sleep_until(next);
+	}
+}
+
+bool PhysicsWorld::runCommands() {
+	bool any = false;
+	Command command;
+	
+	while (m_commands.pop(command)) {
+		any = true;
+		m_commandsRun++;
+		btRigidBody* body = loadedBodies[command.body];
+		
+		switch (command.type) {
+			case Command::IMPULSE:
+				body->activate();
+				body->applyImpulse(command.vector, command.point);
+				break;
+			case Command::PLACE: {
+				btTransform transform;
+				transform.setIdentity();
+				transform.setOrigin(command.vector);
+				
+				body->setWorldTransform(transform);
+				body->setLinearVelocity(btVector3(0, 0, 0));
+				body->setAngularVelocity(btVector3(0, 0, 0));
+				
+				//Jump straight there rather than sliding across from the last step
+				m_lastStates[command.body].origin = command.vector;
+				m_lastStates[command.body].rotation = btQuaternion::getIdentity();
+				break;
+			}
+		}
+	}
+	
+	return any;
+}
+
+void PhysicsWorld::publishSnapshot(bool interpolate) {
+	Snapshot& snapshot = m_snapshots[m_writeIndex];
+	
+	for (int i = 0; i < loadedBodies.size(); i++) {
+		const btTransform& transform = loadedBodies[i]->getWorldTransform();
+		BodyState& state = snapshot.current[i];
+		state.origin = transform.getOrigin();
+		state.rotation = transform.getRotation();
+		state.velocity = loadedBodies[i]->getLinearVelocity();
+	}
+	
+	snapshot.previous = interpolate ? m_lastStates : snapshot.current;
+	m_lastStates = snapshot.current;
+	snapshot.time = std::chrono::steady_clock::now();
+	snapshot.commandsRun = m_commandsRun;
+	
+	m_writeIndex = m_readyIndex.exchange(m_writeIndex | PHYSICS_SNAPSHOT_FRESH) & ~PHYSICS_SNAPSHOT_FRESH;
+}
+
+void PhysicsWorld::updateSnapshot() {
+	if (m_readyIndex.load() & PHYSICS_SNAPSHOT_FRESH) {
+		m_readIndex = m_readyIndex.exchange(m_readIndex) & ~PHYSICS_SNAPSHOT_FRESH;
+	}
+	
+	//This frame is drawn up to a step behind the newest one, so there's always a step to be between
+	std::chrono::duration<float> elapsed = std::chrono::steady_clock::now() - m_snapshots[m_readIndex].time;
+	m_alpha = std::min(std::max(elapsed.count() * PHYSICS_STEP_RATE, 0.0f), 1.0f);
+}
+
+btTransform PhysicsWorld::interpolatedTransform(int body) const {
+	const Snapshot& snapshot = m_snapshots[m_readIndex];
+	const BodyState& from = snapshot.previous[body];
+	const BodyState& to = snapshot.current[body];
+	
+	btTransform transform;
+	transform.setOrigin(from.origin.lerp(to.origin, m_alpha));
+	transform.setRotation(from.rotation.slerp(to.rotation, m_alpha));
+	return transform;
+}
+
+const PhysicsWorld::BodyState& PhysicsWorld::bodyState(int body) const {
+	return m_snapshots[m_readIndex].current[body];
+}
+
+void PhysicsWorld::updateGame() {
 	//All of the stuff below doesn't need to be checked if we aren't waiting for the next shot
-	if (PhysicsWorld::game->mode != MODE_WAIT_NEXT) return;
+	if (game->mode != MODE_WAIT_NEXT) return;
 	
-	btRigidBody* ball;
+	//A shot that hasn't been stepped yet would look like every ball is resting
+	if (m_snapshots[m_readIndex].commandsRun != m_commandsSent) return;
+	
+	btVector3 position;
 	btVector3 velocity;
 	btScalar speed;
 	
 	bool resting = true;
-	if (PhysicsWorld::game != nullptr) {
+	if (game != nullptr) {
 		int sunkBall = 0;
 		float maxSpeed = .02;
 		
@@ -261,29 +697,29 @@ static void myTickCallback(btDynamicsWorld* world, btScalar timeStep) {
 		// i.e. place out of bounds balls back on table
 		//		prep cue ball placement on scratch/new game
 		//		swap players on turn change
-		if (!PhysicsWorld::game->isGameOver && PhysicsWorld::game->mode == MODE_WAIT_NEXT) {
+		if (!game->isGameOver && game->mode == MODE_WAIT_NEXT) {
 			// Check Stripes Resting
-			for (int i = 0; i < tempWorld->ballIndices.size(); i++) {
-				velocity = (*(tempWorld->getLoadedBodies()))[tempWorld->ballIndices[i]]->getLinearVelocity();
+			for (int i = 0; i < ballIndices.size(); i++) {
+				velocity = bodyState(ballIndices[i]).velocity;
 				speed = velocity.length();
 				if (speed > maxSpeed) { resting = false;}
-				if (PhysicsWorld::game->sunk[i]) { sunkBall++; }
+				if (game->sunk[i]) { sunkBall++; }
 			}
 			
 			if (resting) {
-				if (PhysicsWorld::game->isTurnChange && !PhysicsWorld::game->turnSwapped) {
-					PhysicsWorld::game->isPlayer1 = !PhysicsWorld::game->isPlayer1;
-					PhysicsWorld::game->turnSwapped = true;
-					PhysicsWorld::game->isTurnChange = true;
+				if (game->isTurnChange && !game->turnSwapped) {
+					game->isPlayer1 = !game->isPlayer1;
+					game->turnSwapped = true;
+					game->isTurnChange = true;
 
 				} else {
-					PhysicsWorld::game->turnSwapped = true;
-					PhysicsWorld::game->isTurnChange = true;
+					game->turnSwapped = true;
+					game->isTurnChange = true;
 				}
 				
-				if (!PhysicsWorld::game->isNextShotOK && PhysicsWorld::game->turnSwapped) {
+				if (!game->isNextShotOK && game->turnSwapped) {
 					//std::cout << "playerShot ready" << std::endl;
-					PhysicsWorld::game->isNextShotOK = true;
+					game->isNextShotOK = true;
 
 					// ToDo::Place out of bounds balls
 					// if cue-ball out of bounds
@@ -293,110 +729,161 @@ static void myTickCallback(btDynamicsWorld* world, btScalar timeStep) {
 					// 	place cue-ball in kitchen (later: have player set cue-ball
 				}
 				
-				PhysicsWorld::game->mode = MODE_TAKE_SHOT;
+				game->mode = MODE_TAKE_SHOT;
 			}
 		}
 	}
 	
-	for (int i = 0; i < tempWorld->ballIndices.size(); i++) {
-		// Clamp the velocity to help prevent tunneling
-		ball = (*(tempWorld->getLoadedBodies()))[tempWorld->ballIndices[i]];
-		velocity = ball->getLinearVelocity();
-		speed = velocity.length();
-		if (speed > mMaxSpeed) {
-			velocity *= mMaxSpeed / speed;
-			ball->setLinearVelocity(velocity);
-		}
+	for (int i = 0; i < ballIndices.size(); i++) {
+		position = bodyState(ballIndices[i]).origin;
 		
 		// Stripes Ball location trigger
-		if (ball->getCenterOfMassPosition().y() < -.1) {
+		if (position.y() < -.1) {
 			// if fell through table - is in pocket
-			if(tempWorld->ballIndices[i] == PhysicsWorld::game->cueBall) {
-				PhysicsWorld::game->mode = MODE_PLACE_CUE;
-				PhysicsWorld::game->kMod = (ball->getCenterOfMassPosition().z() > 0)
-				                           ? 1 : -1;
+			if(ballIndices[i] == game->cueBall) {
+				game->mode = MODE_PLACE_CUE;
+				game->kMod = (position.z() > 0) ? 1 : -1;
 				
-				PhysicsWorld::game->isPlayer1 = !PhysicsWorld::game->isPlayer1;
-				PhysicsWorld::game->turnSwapped = true;
-				PhysicsWorld::game->isTurnChange = true;
+				game->isPlayer1 = !game->isPlayer1;
+				game->turnSwapped = true;
+				game->isTurnChange = true;
 				
-			} else if (!PhysicsWorld::game->sunk[i] && !PhysicsWorld::game->oob[i]) {
+			} else if (!game->sunk[i] && !game->oob[i]) {
 				// ToDo: check for more accurate board size (ball must be in bounds)
-				if (ball->getCenterOfMassPosition().x() <= 4.5 &&
-						ball->getCenterOfMassPosition().x() >= -4.5 &&
-						ball->getCenterOfMassPosition().z() < 6 &&
-						ball->getCenterOfMassPosition().z() > -6) {
+				if (position.x() <= 4.5 &&
+						position.x() >= -4.5 &&
+						position.z() < 6 &&
+						position.z() > -6) {
 					
 					std::cout << "ball sunk: " << i << std::endl;
 					
-					if(tempWorld->ballIndices[i] == PhysicsWorld::game->eightBall) {
+					if(ballIndices[i] == game->eightBall) {
 						int numSunk = 0;
 						int beginIndex;
-						if((PhysicsWorld::game->isPlayer1 && PhysicsWorld::game->isPlayer1Solids) ||
-								!(PhysicsWorld::game->isPlayer1 || PhysicsWorld::game->isPlayer1Solids)) {
+						if((game->isPlayer1 && game->isPlayer1Solids) ||
+								!(game->isPlayer1 || game->isPlayer1Solids)) {
 							beginIndex = 1;
 						} else {
 							beginIndex = 9;
 						}
 						
 						for(int i = beginIndex; i < beginIndex + 7; i++) {
-							if(PhysicsWorld::game->sunk[i]) numSunk++;
+							if(game->sunk[i]) numSunk++;
 						}
 
-						int playerWinner = (((numSunk == 7 && PhysicsWorld::game->isPlayer1) || !(numSunk == 7 || PhysicsWorld::game->isPlayer1)) ? 1 : 2);
+						int playerWinner = (((numSunk == 7 && game->isPlayer1) || !(numSunk == 7 || game->isPlayer1)) ? 1 : 2);
 						std::cout << "Player "
 						          << playerWinner
 						          << " wins!" << std::endl;
-						PhysicsWorld::game->isGameOver = true;
+						game->isGameOver = true;
 						if(playerWinner == 1)
 						{
-							PhysicsWorld::game->isPlayer1Win = true;
+							game->isPlayer1Win = true;
 						}
-						PhysicsWorld::game->mode = MODE_NONE;
+						game->mode = MODE_NONE;
 						return;
 					}
 					
 					//Stripes/Solids hasn't been decided yet
-					if (!PhysicsWorld::game->isPlayer1Solids && !PhysicsWorld::game->isPlayer1Stripes) {
-						if ((PhysicsWorld::game->isPlayer1 && i > 8) || !(PhysicsWorld::game->isPlayer1 || i > 8)) {
-							PhysicsWorld::game->isPlayer1Stripes = true;
+					if (!game->isPlayer1Solids && !game->isPlayer1Stripes) {
+						if ((game->isPlayer1 && i > 8) || !(game->isPlayer1 || i > 8)) {
+							game->isPlayer1Stripes = true;
 						} else {
-							PhysicsWorld::game->isPlayer1Solids = true;
+							game->isPlayer1Solids = true;
 						}
 					}
 
 					// Player's ball is sunk, so set variables to not swap turns
-					if ((PhysicsWorld::game->isPlayer1 && PhysicsWorld::game->isPlayer1Solids && i < 8) ||
-							!(PhysicsWorld::game->isPlayer1 || PhysicsWorld::game->isPlayer1Solids || i < 8)) {
-						PhysicsWorld::game->isTurnChange = false;
-						PhysicsWorld::game->turnSwapped = false;
+					if ((game->isPlayer1 && game->isPlayer1Solids && i < 8) ||
+							!(game->isPlayer1 || game->isPlayer1Solids || i < 8)) {
+						game->isTurnChange = false;
+						game->turnSwapped = false;
 					}
 					
-					PhysicsWorld::game->sunk[i] = true;
-					
-					btTransform ballTransform;
-					ballTransform.setIdentity();
-					ballTransform.setOrigin(btVector3(i, 0, 0));
+					game->sunk[i] = true;
 					
-					ball->setWorldTransform(ballTransform);
-					ball->setLinearVelocity(btVector3(0, 0, 0));
-					ball->setAngularVelocity(btVector3(0, 0, 0));
+					placeBody(ballIndices[i], btVector3(i, 0, 0));
 				} else {
 					
 					std::cout << "ball oob: " << i << std::endl;
-					PhysicsWorld::game->oob[i] = true;
-					btTransform ballTransform;
-					ballTransform.setIdentity();
-					ballTransform.setOrigin(btVector3(i, 0, 0));
-
-					ball->setWorldTransform(ballTransform);
-					ball->setLinearVelocity(btVector3(0, 0, 0));
-					ball->setAngularVelocity(btVector3(0, 0, 0));
+					game->oob[i] = true;
+					
+					placeBody(ballIndices[i], btVector3(i, 0, 0));
 				}
 			}
 		}
 	}
 }
 
+void PhysicsWorld::benchmark(int body, const btVector3& impulse, unsigned steps) {
+	if (m_running) {
+		std::cerr << "Can't benchmark the physics while it's being stepped" << std::endl;
+		return;
+	}
+	
+	if (!m_thread.joinable()) {
+		std::cerr << "Can't benchmark the physics once its thread has stopped" << std::endl;
+		return;
+	}
+	
+	loadedBodies[body]->activate();
+	loadedBodies[body]->applyCentralImpulse(impulse);
+	
+	//Wait for the physics thread to finish, so nothing touches the world meanwhile
+	std::unique_lock<std::mutex> lock(m_threadMutex);
+	m_benchmarkSteps = steps;
+	m_threadState = THREAD_BENCHMARK;
+	m_threadStateChanged.notify_all();
+	while (m_threadState == THREAD_BENCHMARK) {
+		m_threadStateChanged.wait(lock);
+	}
+}
+
+void PhysicsWorld::runBenchmark() {
+	unsigned steps = m_benchmarkSteps;
+	
+	std::chrono::duration<double, std::milli> total(0);
+	std::chrono::duration<double, std::milli> worst(0);
+	for (unsigned i = 0; i < steps; i++) {
+		std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+		dynamicsWorld->stepSimulation(btScalar(1.0) / PHYSICS_STEP_RATE, 0);
+		std::chrono::duration<double, std::milli> elapsed = std::chrono::steady_clock::now() - start;
+		
+		total += elapsed;
+		worst = std::max(worst, elapsed);
+	}
+	
+	std::cout << "Physics benchmark: "
+	          << (m_taskScheduler != nullptr ? "multithreaded" : "single threaded") << " world, "
+	          << (m_jobPool != nullptr ? m_jobPool->size() + 1 : 1) << " threads, "
+	          << loadedBodies.size() << " bodies, "
+	          << steps << " steps" << std::endl
+	          << "    " << total.count() / steps << " ms per step, "
+	          << worst.count() << " ms worst, "
+	          << total.count() << " ms total" << std::endl;
+}
+
+// On each physics tick, clamp the ball velocities
+static void myTickCallback(btDynamicsWorld* world, btScalar timeStep) {
+	// This section clamps the velocity (mMaxSpeed) of objects that are set to be clamped
+	PhysicsWorld* tempWorld = static_cast<PhysicsWorld*>(world->getWorldUserInfo());
+	int mMaxSpeed = 200;
+	
+	btRigidBody* ball;
+	btVector3 velocity;
+	btScalar speed;
+	
+	for (int i = 0; i < tempWorld->ballIndices.size(); i++) {
+		// Clamp the velocity to help prevent tunneling
+		ball = (*(tempWorld->getLoadedBodies()))[tempWorld->ballIndices[i]];
+		velocity = ball->getLinearVelocity();
+		speed = velocity.length();
+		if (speed > mMaxSpeed) {
+			velocity *= mMaxSpeed / speed;
+			ball->setLinearVelocity(velocity);
+		}
+	}
+}
+
 #endif
 
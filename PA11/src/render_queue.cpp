@@ -0,0 +1,48 @@
+#include "render_queue.h"
+
+uint64_t RenderQueue::makeKey(unsigned pass, unsigned program, unsigned textures, unsigned model, float depth) {
+	if(depth < 0.0f) depth = 0.0f;
+	if(depth > 1.0f) depth = 1.0f;
+
+	uint64_t key = 0;
+	key |= uint64_t(pass & 0xF) << 60;
+	key |= uint64_t(program & 0xFFF) << 48;
+	key |= uint64_t(textures & 0xFFFF) << 32;
+	key |= uint64_t(model & 0xFFFF) << 16;
+	key |= uint64_t(depth * 0xFFFF);
+
+	return key;
+}
+
+RenderQueue::RenderQueue() : m_items(nullptr), m_count(0), m_capacity(0) {}
+
+void RenderQueue::clear(FrameArena& arena, unsigned capacity) {
+	m_items = arena.allocate<Item>(capacity);
+	m_count = 0;
+	m_capacity = capacity;
+}
+
+void RenderQueue::push(uint64_t key, int object, int group) {
+	if(m_count >= m_capacity) return;
+
+	m_items[m_count].key = key;
+	m_items[m_count].object = object;
+	m_items[m_count].group = group;
+	m_count++;
+}
+
+void RenderQueue::sort() {
+	std::sort(m_items, m_items + m_count, compareItems);
+}
+
+const RenderQueue::Item* RenderQueue::begin() const {
+	return m_items;
+}
+
+const RenderQueue::Item* RenderQueue::end() const {
+	return m_items + m_count;
+}
+
+bool RenderQueue::compareItems(const Item& a, const Item& b) {
+	return a.key < b.key;
+}
@@ -1,9 +1,23 @@
 #include "shader.h"
+#include "mapped_file.h"
+#include "gl_state.h"
+
+#include <cstdio>
+#include <cstring>
+#include <sys/stat.h>
 
 std::unordered_map<std::string, Shader*> Shader::loadedShaders;
+unsigned Shader::sortIDCounter = 0;
 
 Shader::Shader() {
 	m_shaderProg = 0;
+	sortID = sortIDCounter++;
+	
+	//Nothing's set until the program has been linked
+	for(auto& i : m_uniforms) {
+		i.location = INVALID_UNIFORM_LOCATION;
+		i.size = 0;
+	}
 }
 
 Shader::~Shader() {
@@ -12,56 +26,158 @@ Shader::~Shader() {
 	}
 	
 	if (m_shaderProg != 0) {
-		glDeleteProgram(m_shaderProg);
+		GLState::deleteProgram(m_shaderProg);
 		m_shaderProg = 0;
 	}
 }
 
 bool Shader::Initialize(std::unordered_map<std::string, std::string> const * dictionary) {
-	if(!initialised && !erroredOut) {
-		m_shaderProg = glCreateProgram();
-		
-		if (m_shaderProg == 0) {
-			std::cerr << "Error creating shader program\n";
-			return false;
-		}
-		
-		if (!AddShader(GL_VERTEX_SHADER, vertexShader, dictionary)) return false;
-		if (!AddShader(GL_FRAGMENT_SHADER, fragmentShader, dictionary)) return false;
-		if (geometryShader != "" && !AddShader(GL_GEOMETRY_SHADER, geometryShader, dictionary)) return false;
-		
-		initialised = true;
+	StartCompile(dictionary);
+	return FinishCompile();
+}
+
+void Shader::InitializeAsync(std::unordered_map<std::string, std::string> const * dictionary) {
+	StartCompile(dictionary);
+}
+
+bool Shader::IsReady(bool block) {
+	if (!initialised || erroredOut) return false;
+	if (!compiling) return true;
+	
+	//Without the extension, asking for the result is what waits for it
+	//A program loaded from a binary has nothing left to wait for
+	if (!block && !loadedBinary) {
+		if (!ParallelCompileSupported()) return false;
 		
-		erroredOut = !Finalize();
-		return !erroredOut;
+		GLint done = GL_FALSE;
+		glGetProgramiv(m_shaderProg, GL_COMPLETION_STATUS_KHR, &done);
+		if (!done) return false;
 	}
 	
-	return true;
+	return FinishCompile();
 }
 
-// Use this method to add shaders to the program. When finished - call finalize()
-bool Shader::AddShader(GLenum ShaderType, const std::string &s, std::unordered_map<std::string, std::string> const * dictionary) {
-	GLuint ShaderObj = glCreateShader(ShaderType);
+bool Shader::ParallelCompileSupported() {
+	static bool supported = glewIsSupported("GL_KHR_parallel_shader_compile") || glewIsSupported("GL_ARB_parallel_shader_compile");
+	return supported;
+}
+
+void Shader::StartCompile(std::unordered_map<std::string, std::string> const * dictionary) {
+	if (initialised || erroredOut) return;
 	
-	if (ShaderObj == 0) {
-		std::cerr << "Error creating shader type " << ShaderType << std::endl;
-		return false;
+	m_shaderProg = glCreateProgram();
+	
+	if (m_shaderProg == 0) {
+		std::cerr << "Error creating shader program\n";
+		erroredOut = true;
+		return;
 	}
 	
-	// Save the shader object - will be deleted in the destructor
-	m_shaderObjList.push_back(ShaderObj);
+	initialised = true;
+	compiling = true;
+	
+	std::string vertex = Preprocess(vertexShader, dictionary);
+	std::string fragment = Preprocess(fragmentShader, dictionary);
+	std::string geometry = Preprocess(geometryShader, dictionary);
+	
+	//Skip compiling entirely if the driver takes back what it gave us last time
+	cacheFile = BinaryCacheFile(vertex, fragment, geometry);
+	loadedBinary = LoadBinary(cacheFile);
+	if (loadedBinary) return;
+	
+	//Nothing below waits for the driver - errors are checked in FinishCompile()
+	if (!AddShader(GL_VERTEX_SHADER, vertex) || !AddShader(GL_FRAGMENT_SHADER, fragment) ||
+	    (geometry != "" && !AddShader(GL_GEOMETRY_SHADER, geometry))) {
+		erroredOut = true;
+		return;
+	}
+	
+	//Ask the driver to keep the binary around for SaveBinary()
+	if (GLEW_ARB_get_program_binary) {
+		glProgramParameteri(m_shaderProg, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
 	
+	glLinkProgram(m_shaderProg);
+}
+
+bool Shader::FinishCompile() {
+	if (!initialised || erroredOut) return false;
+	if (!compiling) return true;
+	
+	compiling = false;
+	
+	if (loadedBinary) {
+		erroredOut = !Configure();
+		return !erroredOut;
+	}
+	
+	for (const auto& i : m_shaderObjList) {
+		GLint success;
+		glGetShaderiv(i, GL_COMPILE_STATUS, &success);
+		
+		if (!success) {
+			GLchar InfoLog[2048];
+			glGetShaderInfoLog(i, 2048, NULL, InfoLog);
+			std::cerr << "Error with " << key << std::endl;
+			std::cerr << "Error compiling: " << InfoLog << std::endl;
+			erroredOut = true;
+			return false;
+		}
+	}
+	
+	erroredOut = !Finalize();
+	if (!erroredOut) {
+		SaveBinary(cacheFile);
+	}
+	return !erroredOut;
+}
+
+std::string Shader::Preprocess(const std::string& s, std::unordered_map<std::string, std::string> const * dictionary) const {
 	std::string shader = s;
 	
+	//Features have to be defined after #version, which must come first
+	size_t versionEnd = 0;
+	if (shader.compare(0, 8, "#version") == 0) {
+		versionEnd = shader.find('\n');
+		versionEnd = versionEnd == std::string::npos ? shader.size() : versionEnd + 1;
+	}
+	shader.insert(versionEnd, features.defines());
+	
+	//Searching carries on after each replacement, rather than from the start again
+	size_t pos;
 	if(dictionary != nullptr) {
-		size_t pos;
 		for(const auto& i : *dictionary) {
-			while((pos = shader.find(i.first)) != std::string::npos) {
+			pos = 0;
+			while((pos = shader.find(i.first, pos)) != std::string::npos) {
 				shader.replace(pos, i.first.size(), i.second);
+				pos += i.second.size();
 			}
 		}
 	}
 	
+	//Instanced variants compile the same source with INSTANCED_DRAW switched on
+	std::string instancedToken = "INSTANCED_DRAW";
+	pos = 0;
+	while((pos = shader.find(instancedToken, pos)) != std::string::npos) {
+		shader.replace(pos, instancedToken.size(), isInstanced ? "1" : "0");
+		pos++;
+	}
+	
+	return shader;
+}
+
+// Use this method to add shaders to the program. When finished - link it, then call finalize()
+bool Shader::AddShader(GLenum ShaderType, const std::string &shader) {
+	GLuint ShaderObj = glCreateShader(ShaderType);
+	
+	if (ShaderObj == 0) {
+		std::cerr << "Error creating shader type " << ShaderType << std::endl;
+		return false;
+	}
+	
+	// Save the shader object - will be deleted in the destructor
+	m_shaderObjList.push_back(ShaderObj);
+	
 	const GLchar *p[1];
 	p[0] = shader.c_str();
 	GLint Lengths[1] = {(GLint) shader.size()};
@@ -70,31 +186,18 @@ bool Shader::AddShader(GLenum ShaderType, const std::string &s, std::unordered_m
 	
 	glCompileShader(ShaderObj);
 	
-	GLint success;
-	glGetShaderiv(ShaderObj, GL_COMPILE_STATUS, &success);
-	
-	if (!success) {
-		GLchar InfoLog[2048];
-		glGetShaderInfoLog(ShaderObj, 2048, NULL, InfoLog);
-		std::cerr << "Error with " << key << std::endl;
-		std::cerr << "Error compiling: " << InfoLog << std::endl;
-		return false;
-	}
-	
 	glAttachShader(m_shaderProg, ShaderObj);
 	
 	return true;
 }
 
 
-// After all the shaders have been added to the program call this function
-// to link and validate the program.
+// After the program has been linked call this function
+// to check and validate the program.
 bool Shader::Finalize() {
 	GLint Success = 0;
 	GLchar ErrorLog[2048] = {0};
 	
-	glLinkProgram(m_shaderProg);
-	
 	glGetProgramiv(m_shaderProg, GL_LINK_STATUS, &Success);
 	if (Success == 0) {
 		glGetProgramInfoLog(m_shaderProg, sizeof(ErrorLog), nullptr, ErrorLog);
@@ -102,9 +205,23 @@ bool Shader::Finalize() {
 		return false;
 	}
 	
+	return Configure();
+}
+
+bool Shader::Configure() {
+	GLint Success = 0;
+	GLchar ErrorLog[2048] = {0};
+	
+	ReflectUniforms();
+	
+	//Point the shared uniform blocks at the buffers they're read from
+	BindUniformBlock("FrameData", UBO_FRAME_BINDING);
+	BindUniformBlock("ObjectData", UBO_OBJECT_BINDING);
+	BindUniformBlock("MaterialData", UBO_MATERIAL_BINDING);
+	
 	//To prevent shader linking errors due to separate samplers referencing same texture
 	Enable();
-	uniform1i("spotlightShadowSampler", 1);
+	uniform1i(UNIFORM_SPOTLIGHT_SHADOW_SAMPLER, 1);
 	
 	glValidateProgram(m_shaderProg);
 	glGetProgramiv(m_shaderProg, GL_VALIDATE_STATUS, &Success);
@@ -124,16 +241,170 @@ bool Shader::Finalize() {
 	return true;
 }
 
+std::string Shader::BinaryCacheFile(const std::string& vertex, const std::string& fragment, const std::string& geometry) {
+	//A new driver, or a different GPU, won't accept old binaries - so they go in the key too
+	std::string keySource = vertex + '\0' + fragment + '\0' + geometry + '\0';
+	const GLenum driverStrings[] = {GL_VENDOR, GL_RENDERER, GL_VERSION};
+	for (const auto& i : driverStrings) {
+		const GLubyte* value = glGetString(i);
+		if (value != nullptr) {
+			keySource += reinterpret_cast<const char*>(value);
+		}
+		keySource += '\0';
+	}
+	
+	//FNV-1a, 64 bits wide
+	uint64_t hash = 14695981039346656037ull;
+	for (const auto& i : keySource) {
+		hash = (hash ^ (unsigned char) i) * 1099511628211ull;
+	}
+	
+	char name[17];
+	snprintf(name, sizeof(name), "%016llx", (unsigned long long) hash);
+	
+	return std::string(SHADER_CACHE_DIR) + name + ".bin";
+}
+
+bool Shader::LoadBinary(const std::string& cacheFile) {
+	if (!GLEW_ARB_get_program_binary) {
+		return false;
+	}
+	
+	MappedFile binary;
+	if (!binary.open(cacheFile) || binary.size() <= sizeof(uint32_t)) {
+		return false;
+	}
+	
+	uint32_t format;
+	memcpy(&format, binary.data(), sizeof(uint32_t));
+	glProgramBinary(m_shaderProg, format, binary.data() + sizeof(uint32_t), binary.size() - sizeof(uint32_t));
+	
+	//Drivers are free to reject binaries for any reason, so this is expected to fail sometimes
+	GLint success = 0;
+	glGetProgramiv(m_shaderProg, GL_LINK_STATUS, &success);
+	if (!success) {
+		std::remove(cacheFile.c_str());
+		return false;
+	}
+	
+	return true;
+}
+
+void Shader::SaveBinary(const std::string& cacheFile) {
+	if (!GLEW_ARB_get_program_binary) {
+		return;
+	}
+	
+	GLint length = 0;
+	glGetProgramiv(m_shaderProg, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+	
+	std::vector<char> binary(length);
+	GLenum format = 0;
+	glGetProgramBinary(m_shaderProg, length, nullptr, &format, binary.data());
+	
+	//Nothing is lost if this fails - the program just gets compiled again next time
+	mkdir(SHADER_CACHE_DIR, 0755);
+	
+	//Write somewhere else first, so another run never loads a half-written binary
+	std::string tempFile = cacheFile + ".tmp";
+	std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+	if (!out.is_open()) {
+		return;
+	}
+	
+	uint32_t storedFormat = format;
+	out.write(reinterpret_cast<const char*>(&storedFormat), sizeof(uint32_t));
+	out.write(binary.data(), binary.size());
+	
+	out.close();
+	if (!out || std::rename(tempFile.c_str(), cacheFile.c_str()) != 0) {
+		std::remove(tempFile.c_str());
+	}
+}
+
 
 void Shader::Enable() {
-	glUseProgram(m_shaderProg);
+	GLState::useProgram(m_shaderProg);
 }
 
 
-GLint Shader::GetUniformLocation(const char *pUniformName) {
-	GLuint Location = glGetUniformLocation(m_shaderProg, pUniformName);
+//What each of the engine's uniforms is called in the shaders, in the same order as Uniform
+static const char* const uniformNames[] = {
+	"gSampler",
+	"gAltSampler",
+	"gNormalSampler",
+	"gSpecularSampler",
+	"spotlightShadowSampler",
+	"MVP",
+	"M",
+	"id",
+	"lightIndex",
+	"aspect",
+	"billboardLocation"
+};
+static_assert(sizeof(uniformNames) / sizeof(uniformNames[0]) == UNIFORM_COUNT, "Every Uniform needs a name");
+
+void Shader::ReflectUniforms() {
+	for(auto& i : m_uniforms) {
+		i.location = INVALID_UNIFORM_LOCATION;
+		i.size = 0;
+	}
 	
-	return Location;
+	GLint numUniforms = 0;
+	GLint maxNameLength = 0;
+	glGetProgramiv(m_shaderProg, GL_ACTIVE_UNIFORMS, &numUniforms);
+	glGetProgramiv(m_shaderProg, GL_ACTIVE_UNIFORM_MAX_LENGTH, &maxNameLength);
+	
+	std::vector<GLchar> name(maxNameLength + 1);
+	for(GLint i = 0; i < numUniforms; i++) {
+		GLint size = 0;
+		GLenum type;
+		GLsizei nameLength = 0;
+		glGetActiveUniform(m_shaderProg, i, name.size(), &nameLength, &size, &type, &name[0]);
+		
+		GLint location = glGetUniformLocation(m_shaderProg, &name[0]);
+		//Uniforms in uniform blocks have no location of their own
+		if(location == INVALID_UNIFORM_LOCATION) continue;
+		
+		//Arrays are reported as "name[0]", but set by just "name"
+		std::string uniformName(&name[0], nameLength);
+		if(uniformName.size() > 3 && uniformName.compare(uniformName.size() - 3, 3, "[0]") == 0) {
+			uniformName.erase(uniformName.size() - 3);
+		}
+		
+		//Anything else is the shader's own business
+		for(unsigned j = 0; j < UNIFORM_COUNT; j++) {
+			if(uniformName == uniformNames[j]) {
+				m_uniforms[j].location = location;
+				m_uniforms[j].size = size;
+				break;
+			}
+		}
+	}
+}
+
+void Shader::BindUniformBlock(const char* blockName, GLuint bindingPoint) {
+	GLuint blockIndex = glGetUniformBlockIndex(m_shaderProg, blockName);
+	//Not every shader uses every block
+	if(blockIndex == GL_INVALID_INDEX) return;
+	
+	glUniformBlockBinding(m_shaderProg, blockIndex, bindingPoint);
+}
+
+const Shader::UniformInfo* Shader::FindUniform(Uniform uniform) const {
+	if(m_uniforms[uniform].location == INVALID_UNIFORM_LOCATION) return nullptr;
+	
+	return &m_uniforms[uniform];
+}
+
+GLint Shader::GetUniformLocation(Uniform uniform) const {
+	const UniformInfo* info = FindUniform(uniform);
+	if(info == nullptr) return INVALID_UNIFORM_LOCATION;
+	
+	return info->location;
 }
 
 Shader *Shader::load(std::string vertexLocation, std::string fragmentLocation, std::string geometryLocation) {
@@ -179,34 +450,102 @@ Shader *Shader::load(std::string vertexLocation, std::string fragmentLocation, s
 	return newShader;
 }
 
-bool Shader::uniform1fv(const char* uniform, GLsizei size, const GLfloat* value) {
-	GLint location = GetUniformLocation(uniform);
-	if(location == INVALID_UNIFORM_LOCATION) return false;
+Shader* Shader::instanced() {
+	if(isInstanced) {
+		return this;
+	}
+	
+	if(instancedShader == nullptr) {
+		instancedShader = new Shader();
+		
+		instancedShader->key = key + " (instanced)";
+		instancedShader->vertexShader = vertexShader;
+		instancedShader->fragmentShader = fragmentShader;
+		instancedShader->geometryShader = geometryShader;
+		instancedShader->isInstanced = true;
+		instancedShader->features = features;
+		instancedShader->initialised = false;
+		
+		loadedShaders[instancedShader->key] = instancedShader;
+	}
+	
+	return instancedShader;
+}
+
+Shader* Shader::variant(const ShaderFeatures& newFeatures) {
+	uint32_t bits = newFeatures.bits();
+	if(bits == features.bits()) {
+		return this;
+	}
+	
+	auto found = variants.find(bits);
+	if(found != variants.end()) {
+		return found->second;
+	}
+	
+	Shader* newVariant = new Shader();
+	
+	newVariant->key = key + " {" + std::to_string(bits) + "}";
+	newVariant->vertexShader = vertexShader;
+	newVariant->fragmentShader = fragmentShader;
+	newVariant->geometryShader = geometryShader;
+	newVariant->isInstanced = isInstanced;
+	newVariant->features = newFeatures;
+	newVariant->initialised = false;
+	
+	variants[bits] = newVariant;
+	loadedShaders[newVariant->key] = newVariant;
+	
+	return newVariant;
+}
+
+uint32_t ShaderFeatures::bits() const {
+	return (hasTexture ? 1 : 0) | (hasNormalMap ? 2 : 0) | (hasSpecularMap ? 4 : 0) | (shadowSamples << 3);
+}
+
+std::string ShaderFeatures::defines() const {
+	return "#define HAS_TEXTURE " + std::to_string(hasTexture ? 1 : 0) + "\n" +
+	       "#define HAS_NORMAL_MAP " + std::to_string(hasNormalMap ? 1 : 0) + "\n" +
+	       "#define HAS_SPECULAR_MAP " + std::to_string(hasSpecularMap ? 1 : 0) + "\n" +
+	       "#define SHADOW_SAMPLES " + std::to_string(shadowSamples) + "\n";
+}
+
+unsigned Shader::GetSortID() const {
+	return sortID;
+}
+
+bool Shader::uniform1fv(Uniform uniform, GLsizei size, const GLfloat* value) {
+	const UniformInfo* info = FindUniform(uniform);
+	if(info == nullptr) return false;
 	
-	glUniform1fv(location, size, value);
+	glUniform1fv(info->location, std::min(size, info->size), value);
+	GLState::countUniformUpload();
 	return true;
 }
 
-bool Shader::uniform3fv(const char* uniform, GLsizei size, const GLfloat* value) {
-	GLint location = GetUniformLocation(uniform);
-	if(location == INVALID_UNIFORM_LOCATION) return false;
+bool Shader::uniform3fv(Uniform uniform, GLsizei size, const GLfloat* value) {
+	const UniformInfo* info = FindUniform(uniform);
+	if(info == nullptr) return false;
 	
-	glUniform3fv(location, size, value);
+	glUniform3fv(info->location, std::min(size, info->size), value);
+	GLState::countUniformUpload();
 	return true;
 }
 
-bool Shader::uniform1i(const char* uniform, GLint value) {
-	GLint location = GetUniformLocation(uniform);
-	if(location == INVALID_UNIFORM_LOCATION) return false;
+bool Shader::uniform1i(Uniform uniform, GLint value) {
+	const UniformInfo* info = FindUniform(uniform);
+	if(info == nullptr) return false;
 	
-	glUniform1i(location, value);
+	glUniform1i(info->location, value);
+	GLState::countUniformUpload();
 	return true;
 }
 
-bool Shader::uniformMatrix4fv(const char* uniform, GLsizei size, GLboolean transpose, const GLfloat* value) {
-	GLint location = GetUniformLocation(uniform);
-	if(location == INVALID_UNIFORM_LOCATION) return false;
+bool Shader::uniformMatrix4fv(Uniform uniform, GLsizei size, GLboolean transpose, const GLfloat* value) {
+	const UniformInfo* info = FindUniform(uniform);
+	if(info == nullptr) return false;
 	
-	glUniformMatrix4fv(location, size, transpose, value);
+	glUniformMatrix4fv(info->location, std::min(size, info->size), transpose, value);
+	GLState::countUniformUpload();
 	return true;
 }
\ No newline at end of file
@@ -8,25 +8,38 @@ in vec3 spotlightDirC[NUM_SPOT_LIGHTS];
 in vec2 uvCoord;
 in vec4 ShadowCoord[NUM_SPOT_LIGHTS];
 
-uniform vec3 MaterialDiffuseColor;
-uniform vec3 MaterialAmbientColor;
-uniform vec3 MaterialSpecularColor;
-uniform float shininess;
-
-uniform vec3 AmbientLight;
-
+//Written once per mesh when the model is loaded - see MaterialDataLayout in uniform_buffer.h
+layout (std140) uniform MaterialData {
+    vec3 MaterialAmbientColor;
+    vec3 MaterialDiffuseColor;
+    vec3 MaterialSpecularColor;
+    float shininess;
+};
+
+//Shared by every lit shader, written once per frame - see FrameDataLayout in uniform_buffer.h
+layout (std140) uniform FrameData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 AmbientLight;
+    mat4 spotlightMatrices[NUM_SPOT_LIGHTS];
+    vec3 spotLightPositions[NUM_SPOT_LIGHTS];
+    vec3 spotLightDirections[NUM_SPOT_LIGHTS];
+    vec3 spotLightColors[NUM_SPOT_LIGHTS];
+    float spotLightStrengths[NUM_SPOT_LIGHTS];
+    float spotLightAngles[NUM_SPOT_LIGHTS];
+};
+
+flat in float highlightAmount;
+
+#if INSTANCED_DRAW
+uniform sampler2DArray gSampler;
+flat in float textureLayer;
+#else
 uniform sampler2D gSampler;
+#endif
 //uniform sampler2DArrayShadow spotlightShadowSampler;
 uniform sampler2DArrayShadow spotlightShadowSampler;
 
-uniform vec3 spotLightPositions[NUM_SPOT_LIGHTS];
-uniform vec3 spotLightDirections[NUM_SPOT_LIGHTS];
-uniform vec3 spotLightColors[NUM_SPOT_LIGHTS];
-uniform float spotLightStrengths[NUM_SPOT_LIGHTS];
-uniform float spotLightAngles[NUM_SPOT_LIGHTS];
-
-uniform int numShadowSamples;
-
 vec2 poissonDisk[16] = vec2[](
    vec2( -0.94201624, -0.39906216 ),
    vec2( 0.94558609, -0.76890725 ),
@@ -57,12 +70,14 @@ vec2 poissonDisk[16] = vec2[](
 out vec4 frag_color;
 
 void main(void) {
+#if INSTANCED_DRAW
+    vec4 MaterialDiffuseTexture2d = texture(gSampler, vec3(uvCoord.st, textureLayer));
+#elif HAS_TEXTURE
     vec4 MaterialDiffuseTexture2d = texture2D(gSampler, uvCoord.st);
-
+#else
     //If we don't have a texture, default to the materials
-    if(MaterialDiffuseTexture2d.rgb == vec3(0.0, 0.0, 0.0)) {
-        MaterialDiffuseTexture2d.rgb = MaterialDiffuseColor;
-    }
+    vec4 MaterialDiffuseTexture2d = vec4(MaterialDiffuseColor, 1.0);
+#endif
 
     vec3 materialAmbientModified = (MaterialAmbientColor) * MaterialDiffuseTexture2d.rgb;
 
@@ -109,19 +124,20 @@ void main(void) {
         cosTheta = max(dot(n, l), 0);
         cosAlpha = max(dot(e, r), 0);
 
+#if SHADOW_SAMPLES > 0
         visibility = 0.05;
-        for(int j = 0; j < numShadowSamples; j++) {
-            visibility += 0.95 / numShadowSamples * texture(spotlightShadowSampler, vec4(ShadowCoord[i].xy + poissonDisk[j] / 3000.0, i, ShadowCoord[i].z - bias));
-        }
-
-        if(numShadowSamples == 0) {
-            visibility = 1.0;
+        for(int j = 0; j < SHADOW_SAMPLES; j++) {
+            visibility += 0.95 / SHADOW_SAMPLES * texture(spotlightShadowSampler, vec4(ShadowCoord[i].xy + poissonDisk[j] / 3000.0, i, ShadowCoord[i].z - bias));
         }
+#else
+        visibility = 1.0;
+#endif
 
         diffuseLight += MaterialDiffuseTexture2d.rgb * spotLightColors[i] * spotLightStrengths[i] * cosTheta * difference * visibility / distance / distance;
         specularLight += MaterialSpecularColor * spotLightColors[i] * spotLightStrengths[i] * pow(cosAlpha, shininess) * difference * visibility / distance / distance;
     }
 
     frag_color.rgb = AmbientLight + materialAmbientModified + diffuseLight + specularLight;
+    frag_color.rgb += highlightAmount * vec3(0.15, 0.15, 0.15);
     frag_color.a   = MaterialDiffuseTexture2d.a;
 }
\ No newline at end of file
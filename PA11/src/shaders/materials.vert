@@ -4,14 +4,37 @@ layout (location = 0) in vec3 positionM;
 layout (location = 1) in vec2 uv;
 layout (location = 2) in vec3 normalM;
 
-uniform mat4 biasMVP[NUM_SPOT_LIGHTS];
+#if INSTANCED_DRAW
+layout (location = 5) in mat4 instanceModelMatrix;
+layout (location = 9) in float instanceTextureLayer;
+layout (location = 11) in float instanceHighlight;
 
-uniform mat4 projectionMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 modelMatrix;
-uniform mat4 modelViewMatrix;
+flat out float textureLayer;
+#else
+//Written for every object once per frame - see ObjectDataLayout in uniform_buffer.h
+layout (std140) uniform ObjectData {
+    mat4 modelMatrix;
+    mat4 modelViewMatrix;
+    mat4 biasMVP[NUM_SPOT_LIGHTS];
+    float highlight;
+};
+#endif
 
-uniform vec3 spotLightPositions[NUM_SPOT_LIGHTS];
+//1 for the object under the mouse, 0 otherwise
+flat out float highlightAmount;
+
+//Shared by every lit shader, written once per frame - see FrameDataLayout in uniform_buffer.h
+layout (std140) uniform FrameData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 AmbientLight;
+    mat4 spotlightMatrices[NUM_SPOT_LIGHTS];
+    vec3 spotLightPositions[NUM_SPOT_LIGHTS];
+    vec3 spotLightDirections[NUM_SPOT_LIGHTS];
+    vec3 spotLightColors[NUM_SPOT_LIGHTS];
+    float spotLightStrengths[NUM_SPOT_LIGHTS];
+    float spotLightAngles[NUM_SPOT_LIGHTS];
+};
 
 out vec3 positionW;
 out vec3 normalC;
@@ -21,6 +44,15 @@ out vec2 uvCoord;
 out vec4 ShadowCoord[NUM_SPOT_LIGHTS];
 
 void main(void) {
+#if INSTANCED_DRAW
+    mat4 modelMatrix = instanceModelMatrix;
+    mat4 modelViewMatrix = viewMatrix * instanceModelMatrix;
+    textureLayer = instanceTextureLayer;
+    highlightAmount = instanceHighlight;
+#else
+    highlightAmount = highlight;
+#endif
+
     vec4 v = vec4(positionM, 1.0);
     gl_Position = (projectionMatrix * modelViewMatrix) * v;
 
@@ -34,7 +66,11 @@ void main(void) {
     for(int i = 0; i < spotLightPositions.length(); i++) {
         lightPosC = (viewMatrix * vec4(spotLightPositions[i], 1.0)).xyz;
         spotlightDirC[i] = lightPosC + eyeC;
+#if INSTANCED_DRAW
+        ShadowCoord[i] = spotlightMatrices[i] * modelMatrix * v;
+#else
         ShadowCoord[i] = biasMVP[i] * v;
+#endif
         ShadowCoord[i] = ShadowCoord[i] / ShadowCoord[i].w / 2 + vec4(0.5, 0.5, 0.5, 0.5);
     }
 
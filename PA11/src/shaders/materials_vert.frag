@@ -5,21 +5,50 @@ in vec3 diffuseLight;
 in vec3 specularLight;
 in vec2 uvCoord;
 
-uniform vec3 MaterialDiffuseColor;
-uniform vec3 MaterialAmbientColor;
-uniform vec3 MaterialSpecularColor;
+//Written once per mesh when the model is loaded - see MaterialDataLayout in uniform_buffer.h
+layout (std140) uniform MaterialData {
+    vec3 MaterialAmbientColor;
+    vec3 MaterialDiffuseColor;
+    vec3 MaterialSpecularColor;
+    float shininess;
+};
 
-uniform vec3 AmbientLight;
+//Shared by every lit shader, written once per frame - see FrameDataLayout in uniform_buffer.h
+layout (std140) uniform FrameData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 AmbientLight;
+    mat4 spotlightMatrices[NUM_SPOT_LIGHTS];
+    vec3 spotLightPositions[NUM_SPOT_LIGHTS];
+    vec3 spotLightDirections[NUM_SPOT_LIGHTS];
+    vec3 spotLightColors[NUM_SPOT_LIGHTS];
+    float spotLightStrengths[NUM_SPOT_LIGHTS];
+    float spotLightAngles[NUM_SPOT_LIGHTS];
+};
 
+flat in float highlightAmount;
+
+#if INSTANCED_DRAW
+uniform sampler2DArray gSampler;
+flat in float textureLayer;
+#else
 uniform sampler2D gSampler;
+#endif
 
 // Output data
 out vec4 frag_color;
 
 void main(void) {
+#if INSTANCED_DRAW
+    vec4 MaterialDiffuseTexture2d = texture(gSampler, vec3(uvCoord.st, textureLayer));
+#elif HAS_TEXTURE
     vec4 MaterialDiffuseTexture2d = texture2D(gSampler, uvCoord.st);
+#else
+    vec4 MaterialDiffuseTexture2d = vec4(MaterialDiffuseColor, 1.0);
+#endif
     vec3 materialAmbientModified = (MaterialAmbientColor) * MaterialDiffuseTexture2d.rgb;
 
     frag_color.rgb = AmbientLight + materialAmbientModified + diffuseLight * MaterialDiffuseTexture2d.rgb + specularLight * MaterialSpecularColor;
+    frag_color.rgb += highlightAmount * vec3(0.15, 0.15, 0.15);
     frag_color.a   = MaterialDiffuseTexture2d.a;
 }
\ No newline at end of file
@@ -4,24 +4,60 @@ layout (location = 0) in vec3 positionM;
 layout (location = 1) in vec2 uv;
 layout (location = 2) in vec3 normalM;
 
-uniform mat4 projectionMatrix;
-uniform mat4 viewMatrix;
-uniform mat4 modelMatrix;
-uniform mat4 modelViewMatrix;
-
-uniform vec3 spotLightPositions[NUM_SPOT_LIGHTS];
-uniform vec3 spotLightDirections[NUM_SPOT_LIGHTS];
-uniform vec3 spotLightColors[NUM_SPOT_LIGHTS];
-uniform float spotLightStrengths[NUM_SPOT_LIGHTS];
-uniform float spotLightAngles[NUM_SPOT_LIGHTS];
-
-uniform float shininess;
+#if INSTANCED_DRAW
+layout (location = 5) in mat4 instanceModelMatrix;
+layout (location = 9) in float instanceTextureLayer;
+layout (location = 11) in float instanceHighlight;
+
+flat out float textureLayer;
+#else
+//Written for every object once per frame - see ObjectDataLayout in uniform_buffer.h
+layout (std140) uniform ObjectData {
+    mat4 modelMatrix;
+    mat4 modelViewMatrix;
+    mat4 biasMVP[NUM_SPOT_LIGHTS];
+    float highlight;
+};
+#endif
+
+//1 for the object under the mouse, 0 otherwise
+flat out float highlightAmount;
+
+//Shared by every lit shader, written once per frame - see FrameDataLayout in uniform_buffer.h
+layout (std140) uniform FrameData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 AmbientLight;
+    mat4 spotlightMatrices[NUM_SPOT_LIGHTS];
+    vec3 spotLightPositions[NUM_SPOT_LIGHTS];
+    vec3 spotLightDirections[NUM_SPOT_LIGHTS];
+    vec3 spotLightColors[NUM_SPOT_LIGHTS];
+    float spotLightStrengths[NUM_SPOT_LIGHTS];
+    float spotLightAngles[NUM_SPOT_LIGHTS];
+};
+
+//Written once per mesh when the model is loaded - see MaterialDataLayout in uniform_buffer.h
+layout (std140) uniform MaterialData {
+    vec3 MaterialAmbientColor;
+    vec3 MaterialDiffuseColor;
+    vec3 MaterialSpecularColor;
+    float shininess;
+};
 
 out vec3 diffuseLight;
 out vec3 specularLight;
 out vec2 uvCoord;
 
 void main(void) {
+#if INSTANCED_DRAW
+    mat4 modelMatrix = instanceModelMatrix;
+    mat4 modelViewMatrix = viewMatrix * instanceModelMatrix;
+    textureLayer = instanceTextureLayer;
+    highlightAmount = instanceHighlight;
+#else
+    highlightAmount = highlight;
+#endif
+
     vec4 v = vec4(positionM, 1.0);
     gl_Position = (projectionMatrix * modelViewMatrix) * v;
 
@@ -2,12 +2,20 @@
 
 in vec3 positionW;
 
+#if INSTANCED_DRAW
+flat in float objectID;
+#else
 uniform float id;
+#endif
 
 // Output data
 out vec4 frag_color;
 
 void main(void) {
     frag_color.rgb = positionW;
+#if INSTANCED_DRAW
+    frag_color.a   = objectID;
+#else
     frag_color.a   = id;
+#endif
 }
\ No newline at end of file
@@ -2,13 +2,30 @@
 
 layout (location = 0) in vec3 positionM;
 
+#if INSTANCED_DRAW
+layout (location = 5) in mat4 instanceModelMatrix;
+layout (location = 10) in float instanceID;
+
+flat out float objectID;
+
+//Just the camera's View-Projection matrix when instanced
+uniform mat4 MVP;
+#else
 uniform mat4 MVP;
 uniform mat4 M;
+#endif
 
 out vec3 positionW;
 
 void main(void) {
+#if INSTANCED_DRAW
+    gl_Position = MVP * instanceModelMatrix * vec4(positionM, 1.0);
+
+    positionW = (instanceModelMatrix * vec4(positionM, 0.0)).xyz;
+    objectID = instanceID;
+#else
     gl_Position = MVP * vec4(positionM, 1.0);
 
     positionW = (M * vec4(positionM, 0.0)).xyz;
+#endif
 }
\ No newline at end of file
@@ -2,8 +2,38 @@
 
 layout (location = 0) in vec3 positionM;
 
-uniform mat4 MVP;
+#if INSTANCED_DRAW
+layout (location = 5) in mat4 instanceModelMatrix;
+#else
+//Written for every object once per frame - see ObjectDataLayout in uniform_buffer.h
+layout (std140) uniform ObjectData {
+    mat4 modelMatrix;
+    mat4 modelViewMatrix;
+    mat4 biasMVP[NUM_SPOT_LIGHTS];
+    float highlight;
+};
+#endif
+
+//Shared by every lit shader, written once per frame - see FrameDataLayout in uniform_buffer.h
+layout (std140) uniform FrameData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 AmbientLight;
+    mat4 spotlightMatrices[NUM_SPOT_LIGHTS];
+    vec3 spotLightPositions[NUM_SPOT_LIGHTS];
+    vec3 spotLightDirections[NUM_SPOT_LIGHTS];
+    vec3 spotLightColors[NUM_SPOT_LIGHTS];
+    float spotLightStrengths[NUM_SPOT_LIGHTS];
+    float spotLightAngles[NUM_SPOT_LIGHTS];
+};
+
+//Which spot light's shadow map we're drawing
+uniform int lightIndex;
 
 void main(void) {
-    gl_Position = MVP * vec4(positionM, 1.0);
+#if INSTANCED_DRAW
+    gl_Position = spotlightMatrices[lightIndex] * instanceModelMatrix * vec4(positionM, 1.0);
+#else
+    gl_Position = biasMVP[lightIndex] * vec4(positionM, 1.0);
+#endif
 }
\ No newline at end of file
@@ -0,0 +1,31 @@
+#version 330 core
+
+in vec2 uvCoord;
+
+//Written once per mesh when the model is loaded - see MaterialDataLayout in uniform_buffer.h
+layout (std140) uniform MaterialData {
+    vec3 MaterialAmbientColor;
+    vec3 MaterialDiffuseColor;
+    vec3 MaterialSpecularColor;
+    float shininess;
+};
+
+#if INSTANCED_DRAW
+uniform sampler2DArray gSampler;
+flat in float textureLayer;
+#else
+uniform sampler2D gSampler;
+#endif
+
+// Output data
+out vec4 frag_color;
+
+void main(void) {
+#if INSTANCED_DRAW
+    frag_color = texture(gSampler, vec3(uvCoord.st, textureLayer));
+#elif HAS_TEXTURE
+    frag_color = texture2D(gSampler, uvCoord.st);
+#else
+    frag_color = vec4(MaterialDiffuseColor, 1.0);
+#endif
+}
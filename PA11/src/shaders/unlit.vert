@@ -0,0 +1,46 @@
+#version 330
+
+//Drawn in place of a lit shader that's still compiling, so it has to be cheap to compile itself
+
+layout (location = 0) in vec3 positionM;
+layout (location = 1) in vec2 uv;
+
+#if INSTANCED_DRAW
+layout (location = 5) in mat4 instanceModelMatrix;
+layout (location = 9) in float instanceTextureLayer;
+
+flat out float textureLayer;
+#else
+//Written for every object once per frame - see ObjectDataLayout in uniform_buffer.h
+layout (std140) uniform ObjectData {
+    mat4 modelMatrix;
+    mat4 modelViewMatrix;
+    mat4 biasMVP[NUM_SPOT_LIGHTS];
+    float highlight;
+};
+#endif
+
+//Shared by every lit shader, written once per frame - see FrameDataLayout in uniform_buffer.h
+layout (std140) uniform FrameData {
+    mat4 viewMatrix;
+    mat4 projectionMatrix;
+    vec3 AmbientLight;
+    mat4 spotlightMatrices[NUM_SPOT_LIGHTS];
+    vec3 spotLightPositions[NUM_SPOT_LIGHTS];
+    vec3 spotLightDirections[NUM_SPOT_LIGHTS];
+    vec3 spotLightColors[NUM_SPOT_LIGHTS];
+    float spotLightStrengths[NUM_SPOT_LIGHTS];
+    float spotLightAngles[NUM_SPOT_LIGHTS];
+};
+
+out vec2 uvCoord;
+
+void main(void) {
+#if INSTANCED_DRAW
+    mat4 modelViewMatrix = viewMatrix * instanceModelMatrix;
+    textureLayer = instanceTextureLayer;
+#endif
+
+    gl_Position = (projectionMatrix * modelViewMatrix) * vec4(positionM, 1.0);
+    uvCoord = uv;
+}
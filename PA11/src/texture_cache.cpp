@@ -0,0 +1,180 @@
+#include "texture_cache.h"
+#include "graphics_headers.h"
+
+#include <fstream>
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+#include <sys/stat.h>
+
+bool TextureCache::describeSource(const std::string& textureFile, Header& header) {
+	struct stat info;
+	if(stat(textureFile.c_str(), &info) != 0) {
+		return false;
+	}
+	
+	header.magic = TEXTURE_CACHE_MAGIC;
+	header.version = TEXTURE_CACHE_VERSION;
+	header.format = 0;
+	header.levelCount = 0;
+	header.sourceTime = info.st_mtime;
+	header.sourceSize = info.st_size;
+	header.sourceHash = 0;
+	header.dataOffset = 0;
+	
+	return true;
+}
+
+uint64_t TextureCache::align(uint64_t offset) {
+	return (offset + TEXTURE_CACHE_ALIGNMENT - 1) & ~uint64_t(TEXTURE_CACHE_ALIGNMENT - 1);
+}
+
+bool TextureCache::read(const std::string& textureFile, MappedFile& mapping, Image& image) {
+	Header expected;
+	if(!describeSource(textureFile, expected)) {
+		return false;
+	}
+	
+	if(!mapping.open(textureFile + TEXTURE_CACHE_EXTENSION) || mapping.size() < sizeof(Header)) {
+		mapping.close();
+		return false;
+	}
+	
+	Header header;
+	memcpy(&header, mapping.data(), sizeof(Header));
+	
+	if(header.magic != TEXTURE_CACHE_MAGIC || header.version != TEXTURE_CACHE_VERSION || header.levelCount == 0) {
+		mapping.close();
+		return false;
+	}
+	
+	//Only hash the texture when the cheap check fails
+	if(header.sourceTime != expected.sourceTime || header.sourceSize != expected.sourceSize) {
+		MappedFile source;
+		if(!source.open(textureFile) || source.size() != header.sourceSize || source.hash() != header.sourceHash) {
+			mapping.close();
+			return false;
+		}
+	}
+	
+	if(sizeof(Header) + sizeof(Level) * header.levelCount > header.dataOffset || header.dataOffset > mapping.size()) {
+		mapping.close();
+		return false;
+	}
+	
+	std::vector<Level> levels(header.levelCount);
+	memcpy(&levels[0], mapping.data() + sizeof(Header), sizeof(Level) * header.levelCount);
+	
+	for(const auto& i : levels) {
+		if(header.dataOffset + i.offset + i.size > mapping.size()) {
+			mapping.close();
+			return false;
+		}
+	}
+	
+	//No copies - the pixels are uploaded straight out of the mapping
+	image.format = header.format;
+	image.levels.swap(levels);
+	image.data = mapping.data() + header.dataOffset;
+	
+	return true;
+}
+
+bool TextureCache::write(const std::string& textureFile, const Image& image) {
+	Header header;
+	if(!describeSource(textureFile, header) || image.levels.empty()) {
+		return false;
+	}
+	
+	MappedFile source;
+	if(!source.open(textureFile)) {
+		return false;
+	}
+	header.sourceHash = source.hash();
+	header.format = image.format;
+	header.levelCount = image.levels.size();
+	header.dataOffset = align(sizeof(Header) + sizeof(Level) * image.levels.size());
+	
+	const Level& last = image.levels.back();
+	uint64_t dataSize = last.offset + last.size;
+	
+	//Write somewhere else first, so a half-written cache is never read
+	std::string cacheFile = textureFile + TEXTURE_CACHE_EXTENSION;
+	std::string tempFile = cacheFile + ".tmp";
+	
+	std::ofstream out(tempFile, std::ios::binary | std::ios::trunc);
+	if(!out.is_open()) {
+		return false;
+	}
+	
+	out.write(reinterpret_cast<const char*>(&header), sizeof(Header));
+	out.write(reinterpret_cast<const char*>(&image.levels[0]), sizeof(Level) * image.levels.size());
+	
+	static const char padding[TEXTURE_CACHE_ALIGNMENT] = {0};
+	out.write(padding, header.dataOffset - sizeof(Header) - sizeof(Level) * image.levels.size());
+	out.write(reinterpret_cast<const char*>(image.data), dataSize);
+	
+	out.close();
+	if(!out) {
+		std::remove(tempFile.c_str());
+		return false;
+	}
+	
+	return std::rename(tempFile.c_str(), cacheFile.c_str()) == 0;
+}
+
+void TextureCache::buildMipChain(const unsigned char* rgba, unsigned width, unsigned height, std::vector<unsigned char>& pixels, Image& image) {
+	image.format = GL_RGBA8;
+	image.levels.clear();
+	
+	//Lay out every level first, so pixels only has to be allocated once
+	uint64_t offset = 0;
+	unsigned levelWidth = width;
+	unsigned levelHeight = height;
+	while(true) {
+		Level level;
+		level.width = levelWidth;
+		level.height = levelHeight;
+		level.offset = offset;
+		level.size = uint64_t(levelWidth) * levelHeight * 4;
+		image.levels.push_back(level);
+		
+		offset = align(offset + level.size);
+		
+		if(levelWidth == 1 && levelHeight == 1) {
+			break;
+		}
+		levelWidth = std::max(1u, levelWidth / 2);
+		levelHeight = std::max(1u, levelHeight / 2);
+	}
+	
+	pixels.assign(offset, 0);
+	memcpy(&pixels[0], rgba, image.levels[0].size);
+	
+	//Each level averages 2x2 blocks of the one before it
+	//Odd sizes just reuse the last row or column
+	for(unsigned i = 1; i < image.levels.size(); i++) {
+		const Level& src = image.levels[i - 1];
+		const Level& dst = image.levels[i];
+		const unsigned char* in = &pixels[src.offset];
+		unsigned char* out = &pixels[dst.offset];
+		
+		for(unsigned y = 0; y < dst.height; y++) {
+			unsigned y0 = std::min(y * 2, src.height - 1);
+			unsigned y1 = std::min(y * 2 + 1, src.height - 1);
+			
+			for(unsigned x = 0; x < dst.width; x++) {
+				unsigned x0 = std::min(x * 2, src.width - 1);
+				unsigned x1 = std::min(x * 2 + 1, src.width - 1);
+				
+				for(unsigned c = 0; c < 4; c++) {
+					unsigned sum = in[(y0 * src.width + x0) * 4 + c] + in[(y0 * src.width + x1) * 4 + c] +
+					               in[(y1 * src.width + x0) * 4 + c] + in[(y1 * src.width + x1) * 4 + c];
+					out[(y * dst.width + x) * 4 + c] = (sum + 2) / 4;
+				}
+			}
+		}
+	}
+	
+	image.data = &pixels[0];
+}
@@ -0,0 +1,136 @@
+#include "uniform_buffer.h"
+#include "gl_state.h"
+
+//std140: mat4s take 64 bytes, arrays of floats and vec3s take 16 bytes per element
+FrameDataLayout::FrameDataLayout(unsigned numSpotLights) {
+	viewMatrix = 0;
+	projectionMatrix = 64;
+	ambientLight = 128;
+	spotlightMatrices = 144;
+	spotLightPositions = spotlightMatrices + 64 * numSpotLights;
+	spotLightDirections = spotLightPositions + 16 * numSpotLights;
+	spotLightColors = spotLightDirections + 16 * numSpotLights;
+	spotLightStrengths = spotLightColors + 16 * numSpotLights;
+	spotLightAngles = spotLightStrengths + 16 * numSpotLights;
+	size = spotLightAngles + 16 * numSpotLights;
+}
+
+ObjectDataLayout::ObjectDataLayout(unsigned numSpotLights) {
+	modelMatrix = 0;
+	modelViewMatrix = 64;
+	biasMVP = 128;
+	highlight = biasMVP + 64 * numSpotLights;
+	size = highlight + 16; //Blocks are padded out to a multiple of 16 bytes
+}
+
+MaterialDataLayout::MaterialDataLayout() {
+	ambient = 0;
+	diffuse = 16;
+	specular = 32;
+	shininess = 44; //Packed in after the vec3
+	size = 48;
+}
+
+UniformBuffer::UniformBuffer(GLuint bindingPoint, size_t blockSize, unsigned capacity, unsigned frames) :
+		m_bindingPoint(bindingPoint),
+		m_blockSize(blockSize),
+		m_stride(blockSize),
+		m_capacity(capacity > 0 ? capacity : 1),
+		m_buffer(0),
+		m_frames(frames > 0 ? frames : 1),
+		m_frame(0),
+		m_fences(m_frames, nullptr),
+		initialised(false) {}
+
+UniformBuffer::~UniformBuffer() {
+	for(auto& i : m_fences) {
+		if(i != nullptr) glDeleteSync(i);
+	}
+	if(m_buffer != 0) {
+		GLState::deleteBuffer(m_buffer);
+	}
+}
+
+void UniformBuffer::initGL() {
+	if(!initialised) {
+		//Every block has to start on an aligned offset so it can be bound on its own
+		GLint alignment = 256;
+		glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+		m_stride = (m_blockSize + alignment - 1) / alignment * alignment;
+
+		glGenBuffers(1, &m_buffer);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+		glBufferData(GL_UNIFORM_BUFFER, m_stride * m_capacity * m_frames, nullptr, m_frames > 1 ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+		GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+
+		m_staging.resize(m_stride * m_capacity);
+
+		initialised = true;
+	}
+}
+
+void UniformBuffer::reserve(unsigned count) {
+	if(count <= m_capacity) return;
+
+	//Nothing can still be reading the old buffer once it's replaced
+	for(auto& i : m_fences) {
+		if(i != nullptr) {
+			glDeleteSync(i);
+			i = nullptr;
+		}
+	}
+
+	m_capacity = count * 2;
+	m_staging.resize(m_stride * m_capacity);
+
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+	glBufferData(GL_UNIFORM_BUFFER, m_stride * m_capacity * m_frames, nullptr, m_frames > 1 ? GL_STREAM_DRAW : GL_STATIC_DRAW);
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, 0);
+}
+
+void UniformBuffer::write(unsigned block, size_t offset, const void* data, size_t size) {
+	reserve(block + 1);
+	memcpy(&m_staging[m_stride * block + offset], data, size);
+}
+
+void UniformBuffer::upload(unsigned count) {
+	if(count == 0) return;
+	reserve(count);
+
+	GLState::bindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+
+	if(m_frames == 1) {
+		glBufferSubData(GL_UNIFORM_BUFFER, 0, m_stride * count, &m_staging[0]);
+	} else {
+		//Move on to the oldest part of the ring - its draws are almost always done by now
+		m_frame = (m_frame + 1) % m_frames;
+		if(m_fences[m_frame] != nullptr) {
+			glClientWaitSync(m_fences[m_frame], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000000);
+			glDeleteSync(m_fences[m_frame]);
+			m_fences[m_frame] = nullptr;
+		}
+
+		//The fence means we can skip OpenGL's own synchronisation
+		void* dest = glMapBufferRange(GL_UNIFORM_BUFFER, m_stride * m_capacity * m_frame, m_stride * count,
+		                              GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+		if(dest != nullptr) {
+			memcpy(dest, &m_staging[0], m_stride * count);
+			glUnmapBuffer(GL_UNIFORM_BUFFER);
+		}
+	}
+
+	GLState::countUniformUpload();
+}
+
+void UniformBuffer::bind(unsigned block) {
+	GLState::bindBufferRange(GL_UNIFORM_BUFFER, m_bindingPoint, m_buffer, m_stride * (m_capacity * m_frame + block), m_blockSize);
+}
+
+void UniformBuffer::fence() {
+	if(m_frames == 1) return;
+
+	if(m_fences[m_frame] != nullptr) {
+		glDeleteSync(m_fences[m_frame]);
+	}
+	m_fences[m_frame] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}